@@ -52,14 +52,14 @@ const char raw[] =
  */
 using MyData = ParsedData<
   /* String */ identification,
-  /* String */ p1_version,
-  /* String */ timestamp,
+  /* StaticString<2> */ p1_version,
+  /* TimestampValue */ timestamp,
   /* String */ equipment_id,
   /* FixedValue */ energy_delivered_tariff1,
   /* FixedValue */ energy_delivered_tariff2,
   /* FixedValue */ energy_returned_tariff1,
   /* FixedValue */ energy_returned_tariff2,
-  /* String */ electricity_tariff,
+  /* StaticString<4> */ electricity_tariff,
   /* FixedValue */ power_delivered,
   /* FixedValue */ power_returned,
   /* FixedValue */ electricity_threshold,
@@ -73,7 +73,7 @@ using MyData = ParsedData<
   /* uint32_t */ electricity_swells_l1,
   /* uint32_t */ electricity_swells_l2,
   /* uint32_t */ electricity_swells_l3,
-  /* String */ message_short,
+  /* StaticString<16> */ message_short,
   /* String */ message_long,
   /* FixedValue */ voltage_l1,
   /* FixedValue */ voltage_l2,
@@ -111,9 +111,9 @@ using MyData = ParsedData<
  *
  * When passed an instance of this Printer object, applyEach will loop
  * over each field and call Printer::apply, passing a reference to each
- * field in turn. This passes the actual field object, not the field
- * value, so each call to Printer::apply will have a differently typed
- * parameter.
+ * field in turn, along with whether it was present in the message. This
+ * passes the actual field object, not the field value, so each call to
+ * Printer::apply will have a differently typed parameter.
  *
  * For this reason, Printer::apply is a template, resulting in one
  * distinct apply method for each field used. This allows looking up
@@ -126,8 +126,8 @@ using MyData = ParsedData<
  */
 struct Printer {
   template<typename Item>
-  void apply(Item &i) {
-    if (i.present()) {
+  void apply(Item &i, bool present) {
+    if (present) {
       Serial.print(Item::get_name());
       Serial.print(F(": "));
       Serial.print(i.val());
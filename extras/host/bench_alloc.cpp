@@ -0,0 +1,128 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Counts heap allocations while parsing a stream of consecutive
+ * telegrams, comparing a ParsedData object that is reused through
+ * reset() with constructing a new one for every telegram. Exits with
+ * an error when reusing the object still allocates after the first
+ * telegram.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "dsmr.h"
+
+static size_t allocations = 0;
+
+void *operator new(size_t size) {
+  ++allocations;
+  void *p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t /* size */) noexcept {
+  free(p);
+}
+
+using MyData = ParsedData<
+  identification,
+  p1_version,
+  timestamp,
+  equipment_id,
+  energy_delivered_tariff1,
+  energy_delivered_tariff2,
+  electricity_tariff,
+  power_delivered,
+  electricity_failure_log,
+  message_long,
+  voltage_l1,
+  current_l1,
+  gas_equipment_id,
+  gas_delivered
+>;
+
+static const size_t TELEGRAMS = 10000;
+
+/**
+ * Writes telegram number i into buf, with values that change for every
+ * telegram, but fields that keep the same length (like a real meter).
+ */
+static size_t make_telegram(char *buf, size_t size, size_t i) {
+  int len = snprintf(buf, size,
+    "/KFM5KAIFA-METER\r\n"
+    "\r\n"
+    "1-3:0.2.8(50)\r\n"
+    "0-0:1.0.0(15011718%02zu%02zuW)\r\n"
+    "0-0:96.1.1(4530303034303031353934373534343134)\r\n"
+    "1-0:1.8.1(%06zu.%03zu*kWh)\r\n"
+    "1-0:1.8.2(%06zu.%03zu*kWh)\r\n"
+    "0-0:96.14.0(000%zu)\r\n"
+    "1-0:1.7.0(%02zu.%03zu*kW)\r\n"
+    "1-0:99.97.0(1)(0-0:96.7.19)(000101000001W)(2147483647*s)\r\n"
+    "0-0:96.13.0(%064zu)\r\n"
+    "1-0:32.7.0(2%02zu.0*V)\r\n"
+    "1-0:31.7.0(%03zu*A)\r\n"
+    "0-1:96.1.0(4730303139333430323231313938343135)\r\n"
+    "0-1:24.2.1(150117180000W)(%05zu.%03zu*m3)\r\n"
+    "!",
+    i / 60 % 60, i % 60, 671 + i / 1000, i % 1000, 842 + i / 1000, i % 1000,
+    1 + i % 2, i / 1000 % 100, i % 1000, i, 20 + i % 40, i % 100, 473 + i / 1000, i % 1000);
+  len += snprintf(buf + len, size - len, "%04X\r\n", crc16_update(0, buf, len));
+  return len;
+}
+
+/**
+ * Parses all telegrams and returns the number of allocations after the
+ * first telegram.
+ */
+template<bool reuse>
+static size_t run(const char *name) {
+  char buf[1024];
+  size_t steady = 0;
+  MyData reused;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < TELEGRAMS; ++i) {
+    size_t len = make_telegram(buf, sizeof(buf), i);
+    size_t before = allocations;
+    bool ok;
+    if (reuse) {
+      reused.reset();
+      ok = !P1Parser::parse(&reused, buf, len).err && reused.all_present();
+    } else {
+      MyData data;
+      ok = !P1Parser::parse(&data, buf, len).err && data.all_present();
+    }
+    if (!ok) {
+      printf("%s: telegram %zu failed to parse\n", name, i);
+      exit(1);
+    }
+    if (i > 0)
+      steady += allocations - before;
+  }
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%-8s %zu telegrams: %zu allocations after the first, %.0f ns per telegram\n",
+         name, TELEGRAMS, steady, secs * 1e9 / TELEGRAMS);
+  return steady;
+}
+
+int main() {
+  run<false>("new");
+  if (run<true>("reset") != 0) {
+    printf("Reusing ParsedData with reset() should not allocate\n");
+    return 1;
+  }
+  return 0;
+}
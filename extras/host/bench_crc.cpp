@@ -0,0 +1,94 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Benchmark for the CRC16 backends in crc.h. Before timing, each
+ * backend is checked to produce exactly the same result as the
+ * original bitwise _crc16_update for all lengths up to a few kiB.
+*/
+
+#include <chrono>
+#include <cstdio>
+
+#include "dsmr/crc.h"
+
+using namespace dsmr;
+
+typedef uint16_t (*CrcFunc)(uint16_t, const char *, size_t);
+
+struct Backend {
+  const char *name;
+  CrcFunc func;
+};
+
+static const Backend backends[] = {
+  { "bitwise", crc16_update_bitwise },
+  { "table", crc16_update_table },
+#ifdef DSMR_CRC16_HAVE_SLICE8
+  { "slice8", crc16_update_slice8 },
+#endif
+#ifdef DSMR_CRC16_HAVE_PCLMUL
+  { "pclmul", crc16_update_pclmul },
+#endif
+  { "default", crc16_update },
+};
+
+static char data[8192];
+
+static bool verify(const Backend& b) {
+  for (size_t n = 0; n < 4096; ++n) {
+    // Vary the alignment and initial value as well
+    const char *start = data + n % 61;
+    uint16_t init = n * 0x9e37;
+    uint16_t expect = init;
+    for (size_t i = 0; i < n; ++i)
+      expect = _crc16_update(expect, start[i]);
+
+    uint16_t got = b.func(init, start, n);
+    if (got != expect) {
+      printf("%s: mismatch for length %zu: %04X != %04X\n", b.name, n, got, expect);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void bench(const Backend& b, size_t len) {
+  // Process about 256MiB in total
+  size_t iterations = (256 << 20) / len;
+  uint16_t crc = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i)
+    crc = b.func(crc, data, len);
+  auto end = std::chrono::steady_clock::now();
+
+  double secs = std::chrono::duration<double>(end - start).count();
+  printf("%-8s %5zu bytes: %8.1f MiB/s (crc %04X)\n", b.name, len, iterations * len / secs / (1 << 20), crc);
+}
+
+int main() {
+  // Simple LCG, to get reproducible data
+  uint32_t x = 1;
+  for (char& c : data) {
+    x = x * 1103515245 + 12345;
+    c = x >> 16;
+  }
+
+  bool ok = true;
+  for (const Backend& b : backends)
+    ok = verify(b) && ok;
+  if (!ok)
+    return 1;
+
+  // A DSMR 4 telegram is about 600 bytes, a DSMR 5 telegram a bit over
+  // 1kiB and much more with long messages.
+  for (size_t len : { 64, 600, 1200, 4096 })
+    for (const Backend& b : backends)
+      bench(b, len);
+
+  return 0;
+}
@@ -0,0 +1,223 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Benchmark that compares finding the field for each line using the
+ * binary search generated by ParsedData::parse_line with the linear
+ * chain of comparisons in ParsedData::parse_line_inlined, for data
+ * structures with 5, 20 and 50 fields.
+ *
+ * Every line of a full telegram is offered to the data structure, so
+ * most lines do not match any field for the smaller structures, just
+ * like when parsing real telegrams.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "dsmr.h"
+
+// Lines for all fields defined in fields.h
+static const char *lines[] = {
+  "1-3:0.2.8(50)",
+  "0-0:1.0.0(150117185916W)",
+  "0-0:96.1.1(4530303034303031353934373534343134)",
+  "1-0:1.8.1(000671.578*kWh)",
+  "1-0:1.8.2(000842.472*kWh)",
+  "1-0:2.8.1(000000.000*kWh)",
+  "1-0:2.8.2(000000.000*kWh)",
+  "0-0:96.14.0(0001)",
+  "1-0:1.7.0(00.333*kW)",
+  "1-0:2.7.0(00.000*kW)",
+  "0-0:17.0.0(999.9*kW)",
+  "0-0:96.3.10(1)",
+  "0-0:96.7.21(00008)",
+  "0-0:96.7.9(00007)",
+  "1-0:99.97.0(1)(0-0:96.7.19)(000101000001W)(2147483647*s)",
+  "1-0:32.32.0(00000)",
+  "1-0:52.32.0(00000)",
+  "1-0:72.32.0(00000)",
+  "1-0:32.36.0(00000)",
+  "1-0:52.36.0(00000)",
+  "1-0:72.36.0(00000)",
+  "0-0:96.13.1()",
+  "0-0:96.13.0()",
+  "1-0:32.7.0(230.1*V)",
+  "1-0:52.7.0(230.2*V)",
+  "1-0:72.7.0(230.3*V)",
+  "1-0:31.7.0(001*A)",
+  "1-0:51.7.0(002*A)",
+  "1-0:71.7.0(003*A)",
+  "1-0:21.7.0(00.332*kW)",
+  "1-0:41.7.0(00.100*kW)",
+  "1-0:61.7.0(00.200*kW)",
+  "1-0:22.7.0(00.000*kW)",
+  "1-0:42.7.0(00.000*kW)",
+  "1-0:62.7.0(00.000*kW)",
+  "0-1:24.1.0(003)",
+  "0-1:96.1.0(4730303339303031363532303530323136)",
+  "0-1:24.4.0(1)",
+  "0-1:24.2.1(150117180000W)(00473.789*m3)",
+  "0-2:24.1.0(007)",
+  "0-2:96.1.0(4730303339303031363532303530323137)",
+  "0-2:24.4.0(1)",
+  "0-2:24.2.1(150117180000W)(00012.345*m3)",
+  "0-3:24.1.0(004)",
+  "0-3:96.1.0(4730303339303031363532303530323138)",
+  "0-3:24.4.0(1)",
+  "0-3:24.2.1(150117180000W)(00001.234*GJ)",
+  "0-4:24.1.0(002)",
+  "0-4:96.1.0(4730303339303031363532303530323139)",
+  "0-4:24.4.0(1)",
+  "0-4:24.2.1(150117180000W)(00001.234*m3)",
+};
+
+using Data5 = ParsedData<
+  identification,
+  energy_delivered_tariff1,
+  energy_delivered_tariff2,
+  power_delivered,
+  gas_delivered
+>;
+
+using Data20 = ParsedData<
+  identification,
+  p1_version,
+  timestamp,
+  equipment_id,
+  energy_delivered_tariff1,
+  energy_delivered_tariff2,
+  energy_returned_tariff1,
+  energy_returned_tariff2,
+  electricity_tariff,
+  power_delivered,
+  power_returned,
+  voltage_l1,
+  voltage_l2,
+  voltage_l3,
+  current_l1,
+  current_l2,
+  current_l3,
+  gas_device_type,
+  gas_equipment_id,
+  gas_delivered
+>;
+
+using Data50 = ParsedData<
+  identification,
+  p1_version,
+  timestamp,
+  equipment_id,
+  energy_delivered_tariff1,
+  energy_delivered_tariff2,
+  energy_returned_tariff1,
+  energy_returned_tariff2,
+  electricity_tariff,
+  power_delivered,
+  power_returned,
+  electricity_failures,
+  electricity_long_failures,
+  electricity_failure_log,
+  electricity_sags_l1,
+  electricity_sags_l2,
+  electricity_sags_l3,
+  electricity_swells_l1,
+  electricity_swells_l2,
+  electricity_swells_l3,
+  message_short,
+  message_long,
+  voltage_l1,
+  voltage_l2,
+  voltage_l3,
+  current_l1,
+  current_l2,
+  current_l3,
+  power_delivered_l1,
+  power_delivered_l2,
+  power_delivered_l3,
+  power_returned_l1,
+  power_returned_l2,
+  power_returned_l3,
+  gas_device_type,
+  gas_equipment_id,
+  gas_valve_position,
+  gas_delivered,
+  thermal_device_type,
+  thermal_equipment_id,
+  thermal_valve_position,
+  thermal_delivered,
+  water_device_type,
+  water_equipment_id,
+  water_valve_position,
+  water_delivered,
+  slave_device_type,
+  slave_equipment_id,
+  slave_valve_position,
+  slave_delivered
+>;
+
+struct Line {
+  ObisId id;
+  const char *value, *end;
+};
+
+static std::vector<Line> parsed_lines;
+
+// Use a non-inlined function for each variant, so the compiler cannot
+// optimize differently based on the call site.
+template <typename Data>
+__attribute__((noinline)) bool parse_binary(Data *data) {
+  for (const Line& l : parsed_lines)
+    if (data->parse_line(l.id, l.value, l.end).err)
+      return false;
+  return true;
+}
+
+template <typename Data>
+__attribute__((noinline)) bool parse_linear(Data *data) {
+  for (const Line& l : parsed_lines)
+    if (data->parse_line_inlined(l.id, l.value, l.end).err)
+      return false;
+  return true;
+}
+
+template <typename Data>
+double bench(bool (*parse)(Data *)) {
+  const size_t iterations = 200000;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    Data data;
+    if (!parse(&data)) {
+      printf("Parse error\n");
+      return 0;
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+template <typename Data>
+void run(const char *name) {
+  double linear = bench<Data>(parse_linear<Data>);
+  double binary = bench<Data>(parse_binary<Data>);
+  printf("%s: linear %7.1f ns, binary search %7.1f ns per telegram\n", name, linear, binary);
+}
+
+int main() {
+  parsed_lines.push_back({ObisId(255, 255, 255, 255, 255, 255), "KFM5KAIFA-METER", nullptr});
+  parsed_lines.back().end = parsed_lines.back().value + strlen(parsed_lines.back().value);
+  for (const char *line : lines) {
+    const char *end = line + strlen(line);
+    ParseResult<ObisId> id = ObisIdParser::parse(line, end);
+    parsed_lines.push_back({id.result, id.next, end});
+  }
+
+  run<Data5>("5 fields");
+  run<Data20>("20 fields");
+  run<Data50>("50 fields");
+  return 0;
+}
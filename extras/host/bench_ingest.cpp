@@ -0,0 +1,229 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Feeds telegrams to the IngestEngine from ingest.h through many local
+ * socketpairs and ptys at once, standing in for meters behind
+ * serial-to-TCP converters and USB ttys.
+ *
+ * Usage: dsmr-bench-ingest [-s sockets] [-p ptys] [-t telegrams] [-w workers]
+ *
+ * A writer thread sends the given number of telegrams (default 10) to
+ * each of the sources (default 1000 socketpairs and 16 ptys), one
+ * telegram to every source in turn and each split into a few writes,
+ * then closes them. The engine runs on the main thread, until all
+ * sources are closed. Afterwards, the CPU time used by the I/O thread
+ * is printed.
+ *
+ * Exits with an error when any telegram was received more than once or
+ * could not be parsed, or was not received without being counted as
+ * dropped (which happens when the workers cannot keep up).
+*/
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dsmr.h"
+#include "ingest.h"
+
+using MyData = ParsedData<
+  identification,
+  timestamp,
+  energy_delivered_tariff1,
+  power_delivered,
+  gas_delivered
+>;
+
+/**
+ * Returns telegram number i for the given source, which contains both
+ * in its identification.
+ */
+static std::string make_telegram(size_t source, size_t i) {
+  char buf[512];
+  int len = snprintf(buf, sizeof(buf),
+    "/ISK5-%zu-%zu\r\n"
+    "\r\n"
+    "1-3:0.2.8(50)\r\n"
+    "0-0:1.0.0(150117185916W)\r\n"
+    "0-0:96.1.1(4530303034303031353934373534343134)\r\n"
+    "1-0:1.8.1(%06zu.%03zu*kWh)\r\n"
+    "1-0:1.8.2(000842.000*kWh)\r\n"
+    "0-0:96.14.0(0001)\r\n"
+    "1-0:1.7.0(00.%03zu*kW)\r\n"
+    "0-1:96.1.0(4730303139333430323231313938343135)\r\n"
+    "0-1:24.2.1(150117180000W)(00473.789*m3)\r\n"
+    "!",
+    source, i, source, i, i % 1000);
+  len += snprintf(buf + len, sizeof(buf) - len, "%04X\r\n", crc16_update(0, buf, len));
+  return std::string(buf, len);
+}
+
+/**
+ * Writes all data, returns false on error.
+ */
+static bool write_all(int fd, const char *data, size_t len) {
+  while (len) {
+    ssize_t n = write(fd, data, len);
+    if (n < 0)
+      return false;
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+/**
+ * Creates a pty in raw mode. Returns the master (read by the engine)
+ * and stores the slave (written by the writer) into slave.
+ */
+static int open_pty(int *slave) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+    return -1;
+  *slave = open(ptsname(master), O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (*slave < 0)
+    return -1;
+  struct termios tio;
+  tcgetattr(*slave, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(*slave, TCSANOW, &tio);
+  return master;
+}
+
+struct Received {
+  // Number of times each telegram was received
+  std::unique_ptr<std::atomic<unsigned>[]> count;
+};
+
+int main(int argc, char **argv) {
+  size_t sockets = 1000, ptys = 16, telegrams = 10;
+  unsigned workers = 2;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:p:t:w:")) != -1) {
+    if (opt == 's') {
+      sockets = strtoul(optarg, NULL, 0);
+    } else if (opt == 'p') {
+      ptys = strtoul(optarg, NULL, 0);
+    } else if (opt == 't') {
+      telegrams = strtoul(optarg, NULL, 0);
+    } else if (opt == 'w') {
+      workers = strtoul(optarg, NULL, 0);
+    } else {
+      fprintf(stderr, "Usage: %s [-s sockets] [-p ptys] [-t telegrams] [-w workers]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // Every source uses two file descriptors
+  struct rlimit limit;
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+
+  size_t sources = sockets + ptys;
+  std::vector<Received> received(sources);
+  std::atomic<size_t> parse_errors(0), unexpected(0);
+  IngestEngine engine([&](const IngestEngine::Source& source, const P1Message& msg) {
+    MyData data;
+    size_t src, i;
+    if (!msg.parse(&data) || !data.all_present()) {
+      parse_errors++;
+    } else if (sscanf(data.identification.c_str(), "ISK5-%zu-%zu", &src, &i) != 2 ||
+               src != (size_t)(uintptr_t)source.user || i >= telegrams) {
+      unexpected++;
+    } else {
+      received[src].count[i]++;
+    }
+  }, workers);
+
+  P1Reader::Stats totals = {};
+  engine.on_close([&](IngestEngine::Source& source) {
+    const P1Reader::Stats& stats = source.reader.stats();
+    totals.overflows += stats.overflows;
+    totals.checksum_errors += stats.checksum_errors;
+    totals.dropped += stats.dropped;
+  });
+
+  std::vector<int> write_fds;
+  for (size_t s = 0; s < sources; ++s) {
+    received[s].count.reset(new std::atomic<unsigned>[telegrams]());
+    int fds[2];
+    if (s < sockets) {
+      if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        perror("socketpair");
+        return 1;
+      }
+    } else if ((fds[0] = open_pty(&fds[1])) < 0) {
+      perror("pty");
+      return 1;
+    }
+    std::string name = (s < sockets ? "socket" : "pty") + std::to_string(s);
+    if (!engine.add(fds[0], name, (void*)(uintptr_t)s)) {
+      perror("epoll");
+      return 1;
+    }
+    write_fds.push_back(fds[1]);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::thread writer([&] {
+    for (size_t i = 0; i < telegrams; ++i) {
+      for (size_t s = 0; s < sources; ++s) {
+        // Split each telegram, like data arriving in a few packets
+        std::string t = make_telegram(s, i);
+        size_t first = t.size() / 3, second = t.size() * 2 / 3;
+        if (!write_all(write_fds[s], t.data(), first) ||
+            !write_all(write_fds[s], t.data() + first, second - first) ||
+            !write_all(write_fds[s], t.data() + second, t.size() - second))
+          perror("write");
+      }
+    }
+    for (int fd : write_fds)
+      close(fd);
+  });
+
+  struct timespec cpu_start, cpu_end;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+  while (engine.size() || engine.stats().handled < engine.stats().messages)
+    engine.poll(-1);
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+  writer.join();
+
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double cpu = (cpu_end.tv_sec - cpu_start.tv_sec) + (cpu_end.tv_nsec - cpu_start.tv_nsec) / 1e9;
+  IngestEngine::Stats stats = engine.stats();
+  printf("%zu sources, %llu telegrams (%llu bytes) in %.2fs\n", sources,
+         (unsigned long long)stats.messages, (unsigned long long)stats.bytes, secs);
+  printf("I/O thread: %.0f ms CPU, %.1f us per telegram\n", cpu * 1e3, cpu * 1e6 / stats.messages);
+  printf("Too long: %u, checksum errors: %u, dropped: %u\n", totals.overflows, totals.checksum_errors, totals.dropped);
+
+  size_t missing = 0, duplicate = 0;
+  for (size_t s = 0; s < sources; ++s) {
+    for (size_t i = 0; i < telegrams; ++i) {
+      if (received[s].count[i] == 0)
+        missing++;
+      else if (received[s].count[i] > 1)
+        duplicate++;
+    }
+  }
+  if (missing != totals.dropped || duplicate || parse_errors || unexpected) {
+    printf("Missing: %zu, duplicate: %zu, parse errors: %zu, unexpected: %zu\n",
+           missing, duplicate, (size_t)parse_errors, (size_t)unexpected);
+    return 1;
+  }
+  return 0;
+}
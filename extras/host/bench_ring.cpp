@@ -0,0 +1,200 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Passes telegrams from a producer thread, standing in for a UART
+ * interrupt handler, through a RingBuffer to a P1Reader, while the
+ * consumer regularly blocks (like a slow task in loop()).
+ *
+ * Usage: dsmr-bench-ring [-r ring size] [-b block ms] [-d seconds]
+ *
+ * First, the producer pushes bytes for the given time (default 3s)
+ * without pause at the rate of a 115200 baud serial port (in bursts
+ * every millisecond), dropping bytes that do not fit, and the consumer
+ * blocks once every second for the given time (default 200ms). This
+ * prints the high-water mark of the ring buffer (default 4096 bytes),
+ * which shows how big it needs to be. Then, the producer pushes bytes
+ * as fast as it can (waiting only when the ring buffer is full) and
+ * the consumer never blocks, to check that no byte is lost or
+ * reordered between the two threads.
+ *
+ * Exits with an error when a telegram was lost without the ring buffer
+ * overflowing.
+*/
+
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dsmr.h"
+
+using MyData = ParsedData<
+  identification,
+  energy_delivered_tariff1,
+  power_delivered
+>;
+
+// 115200 baud with 8N1 framing (10 bits per byte)
+static const size_t BYTES_PER_SECOND = 11520;
+
+/**
+ * Returns telegram number i, which contains i in its identification.
+ */
+static std::string make_telegram(size_t i) {
+  char buf[512];
+  int len = snprintf(buf, sizeof(buf),
+    "/KFM5KAIFA-%zu\r\n"
+    "\r\n"
+    "1-3:0.2.8(50)\r\n"
+    "0-0:1.0.0(150117185916W)\r\n"
+    "0-0:96.1.1(4530303034303031353934373534343134)\r\n"
+    "1-0:1.8.1(%06zu.%03zu*kWh)\r\n"
+    "1-0:1.8.2(000842.000*kWh)\r\n"
+    "0-0:96.14.0(0001)\r\n"
+    "1-0:1.7.0(00.%03zu*kW)\r\n"
+    "1-0:99.97.0(1)(0-0:96.7.19)(000101000001W)(2147483647*s)\r\n"
+    "0-1:96.1.0(4730303139333430323231313938343135)\r\n"
+    "0-1:24.2.1(150117180000W)(00473.789*m3)\r\n"
+    "!",
+    i, 671 + i / 1000, i % 1000, i % 1000);
+  len += snprintf(buf + len, sizeof(buf) - len, "%04X\r\n", crc16_update(0, buf, len));
+  return std::string(buf, len);
+}
+
+struct Result {
+  size_t sent;
+  size_t received;
+  size_t out_of_order;
+  double seconds;
+};
+
+/**
+ * Runs the producer and consumer for the given number of telegrams.
+ * When paced, the producer pushes at BYTES_PER_SECOND and drops bytes
+ * when the ring buffer is full (like an interrupt handler), otherwise
+ * it pushes as fast as possible and waits when the ring buffer is full.
+ * The consumer blocks for block_ms once every second.
+ */
+static Result run(RingBuffer *ring, size_t telegrams, bool paced, int block_ms) {
+  std::string data;
+  for (size_t i = 0; i < telegrams; ++i)
+    data += make_telegram(i);
+
+  std::atomic<bool> done(false);
+  auto start = std::chrono::steady_clock::now();
+  std::thread producer([&] {
+    const uint8_t *p = (const uint8_t*)data.data();
+    size_t pos = 0;
+    while (pos < data.size()) {
+      size_t n = data.size() - pos;
+      if (paced) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        size_t due = secs * BYTES_PER_SECOND;
+        n = due > pos ? due - pos : 0;
+        if (n > data.size() - pos)
+          n = data.size() - pos;
+        ring->push(p + pos, n);
+      } else {
+        size_t space = ring->space();
+        if (!space)
+          std::this_thread::yield();
+        n = ring->push(p + pos, n < space ? n : space);
+      }
+      pos += n;
+    }
+    done = true;
+  });
+
+  std::vector<char> buffer(1024);
+  P1Reader reader(NULL, 0, buffer.data(), buffer.size());
+  reader.enable(false);
+
+  Result res = { telegrams, 0, 0, 0 };
+  size_t expected = 0;
+  auto next_block = start + std::chrono::seconds(1);
+  while (true) {
+    // Check done before draining, so no bytes are left after it
+    bool finished = done;
+    if (reader.drain(ring)) {
+      MyData parsed;
+      if (reader.parse(&parsed)) {
+        size_t id = strtoul(parsed.identification.c_str() + 10, NULL, 10);
+        if (id < expected)
+          res.out_of_order++;
+        expected = id + 1;
+        res.received++;
+      }
+    } else if (finished) {
+      break;
+    } else if (paced) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    } else {
+      std::this_thread::yield();
+    }
+
+    if (block_ms && std::chrono::steady_clock::now() >= next_block) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(block_ms));
+      next_block += std::chrono::seconds(1);
+    }
+  }
+  producer.join();
+  res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return res;
+}
+
+static bool report(const char *name, RingBuffer *ring, const Result &res) {
+  printf("%-8s %zu/%zu telegrams in %.2fs, high water %zu/%zu bytes, %u bytes dropped\n",
+         name, res.received, res.sent, res.seconds, ring->high_water(), ring->capacity(), ring->overflows());
+  if (res.out_of_order || (ring->overflows() == 0 && res.received != res.sent)) {
+    printf("%s: telegrams lost or out of order without overflowing\n", name);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  size_t ring_size = 4096;
+  int block_ms = 200;
+  double duration = 3;
+  int opt;
+  while ((opt = getopt(argc, argv, "r:b:d:")) != -1) {
+    if (opt == 'r') {
+      ring_size = strtoul(optarg, NULL, 0);
+    } else if (opt == 'b') {
+      block_ms = atoi(optarg);
+    } else if (opt == 'd') {
+      duration = atof(optarg);
+    } else {
+      fprintf(stderr, "Usage: %s [-r ring size] [-b block ms] [-d seconds]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (ring_size < 2) {
+    fprintf(stderr, "Ring size should be at least 2\n");
+    return 1;
+  }
+
+  size_t telegram_len = make_telegram(0).size();
+  bool ok = true;
+  {
+    std::vector<uint8_t> storage(ring_size);
+    RingBuffer ring(storage.data(), storage.size());
+    size_t telegrams = duration * BYTES_PER_SECOND / telegram_len + 1;
+    ok &= report("paced", &ring, run(&ring, telegrams, true, block_ms));
+  }
+  {
+    std::vector<uint8_t> storage(ring_size);
+    RingBuffer ring(storage.data(), storage.size());
+    ok &= report("unpaced", &ring, run(&ring, 20000, false, 0));
+  }
+  return ok ? 0 : 1;
+}
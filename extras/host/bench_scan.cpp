@@ -0,0 +1,118 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Benchmark for the line ending scanners in scan.h. Before timing, each
+ * backend is checked to find exactly the same line endings as the
+ * scalar version, for many lengths, alignments and batch sizes.
+*/
+
+#include <chrono>
+#include <cstdio>
+
+#include "dsmr/scan.h"
+
+using namespace dsmr;
+
+typedef size_t (*ScanFunc)(const char *, const char *, const char **, size_t);
+
+struct Backend {
+  const char *name;
+  ScanFunc func;
+};
+
+static const Backend backends[] = {
+  { "scalar", find_line_ends_scalar },
+#ifdef DSMR_SCAN_HAVE_SWAR
+  { "swar", find_line_ends_swar },
+#endif
+#ifdef DSMR_SCAN_HAVE_SSE2
+  // This uses AVX2 when supported
+  { "sse2", find_line_ends_sse2 },
+#endif
+#ifdef DSMR_SCAN_HAVE_NEON
+  { "neon", find_line_ends_neon },
+#endif
+  { "default", find_line_ends },
+};
+
+static char data[8192];
+
+// Finds all line endings using the given backend and batch size and
+// returns a checksum of their positions.
+static size_t scan_all(const Backend& b, const char *str, const char *end, size_t batch) {
+  const char *ends[64];
+  size_t sum = 0;
+  while (true) {
+    size_t n = b.func(str, end, ends, batch);
+    for (size_t i = 0; i < n; ++i)
+      sum = sum * 31 + (ends[i] - data);
+    if (n < batch)
+      return sum;
+    str = ends[n - 1] + 1;
+  }
+}
+
+static bool verify(const Backend& b) {
+  for (size_t n = 0; n < 2048; ++n) {
+    // Vary the alignment and batch size as well
+    const char *start = data + n % 61;
+    size_t batch = 1 + n % 64;
+    size_t expect = scan_all(backends[0], start, start + n, batch);
+    size_t got = scan_all(b, start, start + n, batch);
+    if (got != expect) {
+      printf("%s: mismatch for length %zu, batch %zu\n", b.name, n, batch);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void bench(const Backend& b, size_t len) {
+  // Process about 256MiB in total
+  size_t iterations = (256 << 20) / len;
+  size_t sum = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i)
+    sum += scan_all(b, data, data + len, DSMR_SCAN_BATCH);
+  auto end = std::chrono::steady_clock::now();
+
+  double secs = std::chrono::duration<double>(end - start).count();
+  printf("%-8s %5zu bytes: %8.1f MiB/s (sum %zx)\n", b.name, len, iterations * len / secs / (1 << 20), sum);
+}
+
+int main() {
+  // Fill with lines of 10 to 50 (random) printable characters, ended
+  // by \r\n, like a P1 message. Use a simple LCG, to get reproducible
+  // data.
+  uint32_t x = 1;
+  size_t line_left = 0;
+  for (size_t i = 0; i < sizeof(data); ++i) {
+    x = x * 1103515245 + 12345;
+    if (line_left == 0) {
+      data[i] = '\r';
+      if (++i < sizeof(data))
+        data[i] = '\n';
+      line_left = 10 + (x >> 16) % 40;
+    } else {
+      data[i] = ' ' + (x >> 16) % 95;
+      --line_left;
+    }
+  }
+
+  bool ok = true;
+  for (const Backend& b : backends)
+    ok = verify(b) && ok;
+  if (!ok)
+    return 1;
+
+  for (size_t len : { 64, 600, 1200, 4096 })
+    for (const Backend& b : backends)
+      bench(b, len);
+
+  return 0;
+}
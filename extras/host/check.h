@@ -0,0 +1,248 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Sample messages and helpers for the check programs that compare
+ * other ways of parsing against P1Parser::parse().
+*/
+
+#ifndef DSMR_HOST_CHECK_H
+#define DSMR_HOST_CHECK_H
+
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include "dsmr.h"
+
+/**
+ * The fields used by the checks (at least one of each value type),
+ * passed to the template D, e.g. CheckFields<ParsedData>.
+ */
+template<template<typename...> class D>
+using CheckFields = D<
+  identification,
+  p1_version,
+  timestamp,
+  equipment_id,
+  energy_delivered_tariff1,
+  energy_delivered_tariff2,
+  electricity_tariff,
+  power_delivered,
+  electricity_switch_position,
+  electricity_failures,
+  electricity_failure_log,
+  message_short,
+  message_long,
+  voltage_l1,
+  current_l1,
+  gas_device_type,
+  gas_equipment_id,
+  gas_valve_position,
+  gas_delivered
+>;
+
+// Sample messages, without the / and everything from the ! onwards
+static const char *const samples[] = {
+  // DSMR 4.0
+  "KFM5KAIFA-METER\r\n"
+  "\r\n"
+  "1-3:0.2.8(40)\r\n"
+  "0-0:1.0.0(150117185916W)\r\n"
+  "0-0:96.1.1(0000000000000000000000000000000000)\r\n"
+  "1-0:1.8.1(000671.578*kWh)\r\n"
+  "1-0:1.8.2(000842.472*kWh)\r\n"
+  "1-0:2.8.1(000000.000*kWh)\r\n"
+  "1-0:2.8.2(000000.000*kWh)\r\n"
+  "0-0:96.14.0(0001)\r\n"
+  "1-0:1.7.0(00.333*kW)\r\n"
+  "1-0:2.7.0(00.000*kW)\r\n"
+  "0-0:17.0.0(999.9*kW)\r\n"
+  "0-0:96.3.10(1)\r\n"
+  "0-0:96.7.21(00008)\r\n"
+  "0-0:96.7.9(00007)\r\n"
+  "1-0:99.97.0(1)(0-0:96.7.19)(000101000001W)(2147483647*s)\r\n"
+  "1-0:32.32.0(00000)\r\n"
+  "1-0:32.36.0(00000)\r\n"
+  "0-0:96.13.1()\r\n"
+  "0-0:96.13.0()\r\n"
+  "1-0:31.7.0(001*A)\r\n"
+  "1-0:21.7.0(00.332*kW)\r\n"
+  "1-0:22.7.0(00.000*kW)\r\n"
+  "0-1:24.1.0(003)\r\n"
+  "0-1:96.1.0(0000000000000000000000000000000000)\r\n"
+  "0-1:24.2.1(150117180000W)(00473.789*m3)\r\n"
+  "0-1:24.4.0(1)\r\n",
+  // DSMR 5.0, with a text message and two power failures
+  "ISK5\\2M550T-1012\r\n"
+  "\r\n"
+  "1-3:0.2.8(50)\r\n"
+  "0-0:1.0.0(190314142315W)\r\n"
+  "0-0:96.1.1(4530303433303036383936363032363136)\r\n"
+  "1-0:1.8.1(004521.219*kWh)\r\n"
+  "1-0:1.8.2(003862.902*kWh)\r\n"
+  "1-0:2.8.1(000000.000*kWh)\r\n"
+  "1-0:2.8.2(000000.000*kWh)\r\n"
+  "0-0:96.14.0(0002)\r\n"
+  "1-0:1.7.0(00.518*kW)\r\n"
+  "1-0:2.7.0(00.000*kW)\r\n"
+  "0-0:96.7.21(00010)\r\n"
+  "0-0:96.7.9(00004)\r\n"
+  "1-0:99.97.0(2)(0-0:96.7.19)(180327121005S)(0000001345*s)(170208070009W)(0000000244*s)\r\n"
+  "1-0:32.32.0(00005)\r\n"
+  "1-0:32.36.0(00001)\r\n"
+  "0-0:96.13.0(48656C6C6F)\r\n"
+  "1-0:32.7.0(229.0*V)\r\n"
+  "1-0:31.7.0(002*A)\r\n"
+  "1-0:21.7.0(00.518*kW)\r\n"
+  "1-0:22.7.0(00.000*kW)\r\n"
+  "0-1:24.1.0(003)\r\n"
+  "0-1:96.1.0(4730303339303031383038323238313138)\r\n"
+  "0-1:24.2.1(190314142005W)(02736.184*m3)\r\n",
+  // Placeholder timestamp for a gas meter without a reading
+  "FLU5\\253769484_A\r\n"
+  "\r\n"
+  "0-0:96.1.1(3153414733313031303231363035)\r\n"
+  "0-0:1.0.0(200512135409S)\r\n"
+  "1-0:1.8.1(000000.034*kWh)\r\n"
+  "0-0:96.14.0(0001)\r\n"
+  "1-0:1.7.0(00.000*kW)\r\n"
+  "0-0:96.3.10(1)\r\n"
+  "0-0:96.13.0()\r\n"
+  "0-1:24.1.0(003)\r\n"
+  "0-1:96.1.0(37464C4F32313139303137303030353130)\r\n"
+  "0-1:24.4.0(1)\r\n"
+  "0-1:24.2.1(632525252525S)(00000.000*m3)\r\n",
+};
+
+/**
+ * A line that makes parsing CheckFields fail. It replaces the line of
+ * a sample with the same OBIS id, or is added after the first line
+ * when there is none (or when add is set).
+ */
+struct BrokenLine {
+  const char *line;
+  bool add;
+  // The error, which only happens with unknown_error for
+  // UNKNOWN_FIELD
+  ParseError code;
+};
+
+static const BrokenLine broken_lines[] = {
+  {"1-0:1.8.1(000671.5x8*kWh)", false, ParseError::INVALID_NUMBER},
+  {"1-0:1.8.2(000842.472)", false, ParseError::MISSING_UNIT},
+  {"1-0:1.7.0(00.333*W)", false, ParseError::INVALID_UNIT},
+  {"1-0:1.7.0", false, ParseError::MISSING_OPEN},
+  {"0-0:96.14.0(00011)", false, ParseError::INVALID_STRING_LENGTH},
+  {"0-0:96.13.0(48656C6C6F", false, ParseError::MISSING_CLOSE},
+  {"0-0:96.3.10(1)(2)", false, ParseError::TRAILING_CHARACTERS},
+  {"0-0:96.7.21(1x)", false, ParseError::INVALID_NUMBER},
+  {"0-0:1.0.0(150117185916X)", false, ParseError::INVALID_TIMESTAMP},
+  {"0-1:24.2.1(150117180000W)(00473.789*m3)(1)", false, ParseError::TRAILING_CHARACTERS},
+  {"1-0:1.8.1(000671.578*kWh)", true, ParseError::DUPLICATE_FIELD},
+  {"1-0:1.8.256(000000.000*kWh)", true, ParseError::OBIS_ID_OVERFLOW},
+  {"1-0:2.8.3(000000.000*kWh)", true, ParseError::UNKNOWN_FIELD},
+};
+
+/**
+ * Returns the complete message for the given body (as in samples),
+ * with the / and the correct checksum.
+ */
+static inline std::string telegram(const std::string& body) {
+  std::string t = "/" + body + "!";
+  char crc[5];
+  snprintf(crc, sizeof(crc), "%04X", crc16_update(0, t.data(), t.size()));
+  return t + crc + "\r\n";
+}
+
+/**
+ * Returns body with the broken line put in (see BrokenLine).
+ */
+static inline std::string with_line(const std::string& body, const BrokenLine& broken) {
+  std::string line = broken.line;
+  std::string id = "\n" + line.substr(0, line.find('('));
+  size_t pos = broken.add ? std::string::npos : body.find(id + "(");
+  if (pos == std::string::npos) {
+    pos = body.find('\n');
+    return body.substr(0, pos + 1) + line + "\r\n" + body.substr(pos + 1);
+  }
+  size_t end = body.find('\r', pos + 1);
+  return body.substr(0, pos + 1) + line + body.substr(end);
+}
+
+// Values as exact text, so they can be compared (unlike printer.h,
+// which rounds)
+inline std::string value_str(const FixedValue& v) { return std::to_string(v._value); }
+inline std::string value_str(const TimestampValue& v) {
+  char buf[14];
+  v.raw(buf);
+  return std::string(buf) + (v.valid ? "" : " (not valid)");
+}
+inline std::string value_str(const TimestampedFixedValue& v) {
+  return value_str(v.timestamp) + " " + value_str(static_cast<const FixedValue&>(v));
+}
+inline std::string value_str(const StringView& v) { return std::string(v.data(), v.length()); }
+inline std::string value_str(const std::string& v) { return v; }
+template <size_t N>
+std::string value_str(const StaticString<N>& v) { return std::string(v.c_str(), v.length()); }
+template <typename T>
+std::string value_str(const T& v) { return std::to_string(v); }
+
+// The values of the fields present, by field name
+typedef std::map<std::string, std::string> Values;
+
+struct ValueCollector {
+  Values& values;
+
+  template<typename Item>
+  void apply(Item& i, bool present) {
+    if (present)
+      values[reinterpret_cast<const char*>(Item::get_name())] = value_str(i.val());
+  }
+};
+
+/**
+ * Returns the values of the fields present in data.
+ */
+template<typename Data>
+Values values_of(Data& data) {
+  Values values;
+  data.applyEach(ValueCollector{values});
+  return values;
+}
+
+/**
+ * Prints the differences between the values got and the expected
+ * values and returns false when there are any.
+ */
+static inline bool same_values(const char *what, const Values& got, const Values& want) {
+  if (got == want)
+    return true;
+  printf("%s: wrong values\n", what);
+  for (const auto& v : want) {
+    auto it = got.find(v.first);
+    if (it == got.end())
+      printf("  %s missing, expected %s\n", v.first.c_str(), v.second.c_str());
+    else if (it->second != v.second)
+      printf("  %s is %s, expected %s\n", v.first.c_str(), it->second.c_str(), v.second.c_str());
+  }
+  for (const auto& v : got) {
+    if (!want.count(v.first))
+      printf("  %s is %s, expected not present\n", v.first.c_str(), v.second.c_str());
+  }
+  return false;
+}
+
+/**
+ * Returns the name of the error code, for printing.
+ */
+static inline const char *code_str(ParseError code) {
+  if (code == ParseError::NONE)
+    return "no error";
+  return reinterpret_cast<const char*>(error_message(code));
+}
+
+#endif // DSMR_HOST_CHECK_H
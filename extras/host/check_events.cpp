@@ -0,0 +1,113 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Checks P1Parser::parse_events() against P1Parser::parse(): Parses the
+ * sample messages (as is and with each of the broken lines from
+ * check.h) both ways and compares the values passed to on_field with
+ * the values stored (also those before an error), the error passed to
+ * on_error with the error returned by parse(), and the lines passed to
+ * on_unknown with the lines parse() reports with unknown_error (when
+ * skipping lines).
+ *
+ * Usage: dsmr-check-events
+ *
+ * Prints every mismatch and exits with an error when there are any.
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "dsmr.h"
+#include "check.h"
+
+using MyData = CheckFields<ParsedData>;
+
+struct Collector : public ParseEventHandler {
+  Values values;
+  std::vector<ObisId> unknown;
+  ParseError code = ParseError::NONE;
+  const char *ctx = NULL;
+  // Events received after on_error
+  unsigned late = 0;
+
+  template<typename F, typename V>
+  void on_field(const V& value) {
+    late += code != ParseError::NONE;
+    values[reinterpret_cast<const char*>(F::get_name())] = value_str(value);
+  }
+
+  void on_unknown(const ObisId& id, const StringView& /* value */) {
+    late += code != ParseError::NONE;
+    unknown.push_back(id);
+  }
+
+  void on_error(const ParseResult<void>& res) {
+    late += code != ParseError::NONE;
+    code = res.code;
+    ctx = res.ctx;
+  }
+};
+
+// Passes the fields of CheckFields to parse_events()
+template<typename... Ts>
+struct EventParser {
+  static ParseResult<void> parse(const std::string& t, Collector& collector) {
+    return P1Parser::parse_events<Ts...>(t.data(), t.size(), collector);
+  }
+};
+
+static unsigned check(const char *what, const std::string& t) {
+  MyData data;
+  ParseResult<void> res = P1Parser::parse(&data, t.data(), t.size());
+
+  Collector events;
+  ParseResult<void> events_res = CheckFields<EventParser>::parse(t, events);
+
+  if (events_res.code != res.code || events.code != res.code || events.ctx != res.ctx) {
+    printf("%s: got %s (on_error %s) at %zd, expected %s at %zd\n", what, code_str(events_res.code),
+           code_str(events.code), events.ctx ? events.ctx - t.data() : -1,
+           code_str(res.code), res.ctx ? res.ctx - t.data() : -1);
+    return 1;
+  }
+  if (events.late) {
+    printf("%s: %u events after on_error\n", what, events.late);
+    return 1;
+  }
+  if (!same_values(what, events.values, values_of(data)))
+    return 1;
+  if (res.err)
+    return 0;
+
+  // parse() only reports unknown lines with unknown_error
+  StaticLineErrors<16> skipped;
+  data.reset();
+  P1Parser::parse(&data, t.data(), t.size(), true, &skipped);
+  bool same = events.unknown.size() == skipped.count() && skipped.count() <= skipped.stored();
+  for (size_t i = 0; same && i < events.unknown.size(); ++i)
+    same = events.unknown[i] == skipped[i].id && skipped[i].code == ParseError::UNKNOWN_FIELD;
+  if (!same) {
+    printf("%s: %zu unknown lines, expected %zu\n", what, events.unknown.size(), skipped.count());
+    return 1;
+  }
+  return 0;
+}
+
+int main() {
+  unsigned bad = 0;
+  char what[64];
+  for (size_t i = 0; i < lengthof(samples); ++i) {
+    snprintf(what, sizeof(what), "sample %zu", i);
+    bad += check(what, telegram(samples[i]));
+    for (size_t j = 0; j < lengthof(broken_lines); ++j) {
+      snprintf(what, sizeof(what), "sample %zu, broken line %zu", i, j);
+      bad += check(what, telegram(with_line(samples[i], broken_lines[j])));
+    }
+  }
+  printf("%u bad\n", bad);
+  return bad ? 1 : 0;
+}
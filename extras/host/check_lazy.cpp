@@ -0,0 +1,71 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Checks LazyParsedData against ParsedData: Parses the sample messages
+ * (as is and with each of the broken lines from check.h) with
+ * P1Parser::parse() into both, loads all lazy values and compares the
+ * values and the error (code and position).
+ *
+ * Errors in a value are only found when loading it, after which the
+ * field is not present. So in that case, the values are compared
+ * against parsing into ParsedData with the broken line skipped. This
+ * also means an unknown field after a broken value is reported first,
+ * so unknown_error is not used (the samples have unknown fields).
+ *
+ * Usage: dsmr-check-lazy
+ *
+ * Prints every mismatch and exits with an error when there are any.
+*/
+
+#include <cstdio>
+#include <string>
+
+#include "dsmr.h"
+#include "check.h"
+
+using MyData = CheckFields<ParsedData>;
+using MyLazyData = CheckFields<LazyParsedData>;
+
+static unsigned check(const char *what, const std::string& t) {
+  MyData data;
+  ParseResult<void> res = P1Parser::parse(&data, t.data(), t.size());
+
+  MyLazyData lazy;
+  ParseResult<void> lazy_res = P1Parser::parse(&lazy, t.data(), t.size());
+  bool parsed = !lazy_res.err;
+  if (parsed)
+    lazy_res = lazy.load_all();
+
+  if (lazy_res.code != res.code || lazy_res.ctx != res.ctx) {
+    printf("%s: got %s at %zd, expected %s at %zd\n", what, code_str(lazy_res.code),
+           lazy_res.ctx ? lazy_res.ctx - t.data() : -1, code_str(res.code), res.ctx ? res.ctx - t.data() : -1);
+    return 1;
+  }
+  if (!parsed)
+    return 0;
+
+  // The field with the broken value is left out
+  StaticLineErrors<1> skipped;
+  data.reset();
+  P1Parser::parse(&data, t.data(), t.size(), false, &skipped);
+  return same_values(what, values_of(lazy), values_of(data)) ? 0 : 1;
+}
+
+int main() {
+  unsigned bad = 0;
+  char what[64];
+  for (size_t i = 0; i < lengthof(samples); ++i) {
+    snprintf(what, sizeof(what), "sample %zu", i);
+    bad += check(what, telegram(samples[i]));
+    for (size_t j = 0; j < lengthof(broken_lines); ++j) {
+      snprintf(what, sizeof(what), "sample %zu, broken line %zu", i, j);
+      bad += check(what, telegram(with_line(samples[i], broken_lines[j])));
+    }
+  }
+  printf("%u bad\n", bad);
+  return bad ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Checks P1Parser::parse_multi() (and so MultiParsedData) against
+ * P1Parser::parse(): Parses the sample messages (as is and with each
+ * of the broken lines from check.h) into two ParsedData objects that
+ * share some fields at once, and into a single ParsedData object with
+ * all of their fields. Compares the error, the values of each object
+ * with the values of its fields in the single object and, when
+ * skipping lines, the lines skipped. This is done with and without
+ * unknown_error and skipping lines.
+ *
+ * Usage: dsmr-check-multi
+ *
+ * Prints every mismatch and exits with an error when there are any.
+*/
+
+#include <cstdio>
+#include <string>
+
+#include "dsmr.h"
+#include "check.h"
+
+using First = ParsedData<
+  identification,
+  timestamp,
+  energy_delivered_tariff1,
+  energy_delivered_tariff2,
+  power_delivered,
+  electricity_tariff,
+  message_long,
+  gas_delivered
+>;
+
+using Second = ParsedData<
+  p1_version,
+  energy_delivered_tariff1,
+  power_delivered,
+  electricity_failures,
+  electricity_failure_log,
+  message_short,
+  voltage_l1,
+  current_l1,
+  gas_equipment_id,
+  gas_delivered
+>;
+
+using Both = ParsedData<
+  identification,
+  p1_version,
+  timestamp,
+  energy_delivered_tariff1,
+  energy_delivered_tariff2,
+  power_delivered,
+  electricity_tariff,
+  electricity_failures,
+  electricity_failure_log,
+  message_short,
+  message_long,
+  voltage_l1,
+  current_l1,
+  gas_equipment_id,
+  gas_delivered
+>;
+
+// Copies the values of the fields it is applied to
+struct FieldFilter {
+  const Values& all;
+  Values& values;
+
+  template<typename Item>
+  void apply(Item& /* i */, bool /* present */) {
+    auto it = all.find(reinterpret_cast<const char*>(Item::get_name()));
+    if (it != all.end())
+      values.insert(*it);
+  }
+};
+
+/**
+ * Returns the values for the fields of Data only.
+ */
+template<typename Data>
+Values only_fields_of(const Values& values) {
+  Data data;
+  Values res;
+  data.applyEach(FieldFilter{values, res});
+  return res;
+}
+
+static unsigned check(const std::string& what, const std::string& t, bool unknown_error, bool skip) {
+  StaticLineErrors<16> skipped;
+  Both both;
+  ParseResult<void> res = P1Parser::parse(&both, t.data(), t.size(), unknown_error, skip ? &skipped : NULL);
+
+  StaticLineErrors<16> multi_skipped;
+  First first;
+  Second second;
+  ParseResult<void> multi_res = P1Parser::parse_multi(t.data(), t.size(), unknown_error, skip ? &multi_skipped : NULL, &first, &second);
+
+  if (multi_res.code != res.code || multi_res.ctx != res.ctx) {
+    printf("%s: got %s at %zd, expected %s at %zd\n", what.c_str(), code_str(multi_res.code),
+           multi_res.ctx ? multi_res.ctx - t.data() : -1, code_str(res.code), res.ctx ? res.ctx - t.data() : -1);
+    return 1;
+  }
+
+  bool same = multi_skipped.count() == skipped.count();
+  for (size_t i = 0; same && i < skipped.stored(); ++i)
+    same = multi_skipped[i].code == skipped[i].code && multi_skipped[i].offset == skipped[i].offset;
+  if (!same) {
+    printf("%s: %zu lines skipped, expected %zu (or different errors)\n", what.c_str(), multi_skipped.count(), skipped.count());
+    return 1;
+  }
+
+  Values values = values_of(both);
+  unsigned bad = 0;
+  bad += !same_values((what + ", first").c_str(), values_of(first), only_fields_of<First>(values));
+  bad += !same_values((what + ", second").c_str(), values_of(second), only_fields_of<Second>(values));
+  return bad;
+}
+
+int main() {
+  unsigned bad = 0;
+  char what[64];
+  for (size_t i = 0; i < lengthof(samples); ++i) {
+    for (int mode = 0; mode < 4; ++mode) {
+      bool unknown_error = mode & 1, skip = mode & 2;
+      const char *flags = mode == 0 ? "" : mode == 1 ? " (unknown_error)" : mode == 2 ? " (skipping)" : " (unknown_error, skipping)";
+      snprintf(what, sizeof(what), "sample %zu%s", i, flags);
+      bad += check(what, telegram(samples[i]), unknown_error, skip);
+      for (size_t j = 0; j < lengthof(broken_lines); ++j) {
+        snprintf(what, sizeof(what), "sample %zu, broken line %zu%s", i, j, flags);
+        bad += check(what, telegram(with_line(samples[i], broken_lines[j])), unknown_error, skip);
+      }
+    }
+  }
+  printf("%u bad\n", bad);
+  return bad ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Feeds broken streams of telegrams to a P1Reader (with a 128-byte
+ * buffer, both in normal and in streaming mode) and checks which
+ * telegrams are received and the exact overflow, checksum error and
+ * resync counts. The streams contain truncated telegrams, a / in the
+ * data, checksum or first line, a // prefix, checksum mismatches and a
+ * buffer overflow directly followed by the / of the next telegram.
+ *
+ * Usage: dsmr-check-resync
+ *
+ * Every stream is fed both in one go and one byte at a time. Prints
+ * every mismatch and exits with an error when there are any.
+*/
+
+#include <cstdio>
+#include <string>
+
+#include "dsmr.h"
+
+using MyData = ParsedData<
+  identification,
+  energy_delivered_tariff1
+>;
+
+static const size_t BUFFER_SIZE = 128;
+
+/**
+ * Returns a telegram with the given identification, with a wrong
+ * checksum when bad_crc is set.
+ */
+static std::string telegram(const std::string& id, bool bad_crc = false) {
+  std::string t = "/" + id + "\r\n\r\n1-0:1.8.1(000671.578*kWh)\r\n!";
+  char crc[5];
+  snprintf(crc, sizeof(crc), "%04X", crc16_update(0, t.data(), t.size()) ^ (bad_crc ? 1 : 0));
+  return t + crc + "\r\n";
+}
+
+/**
+ * Returns the start of the telegram, up to (but not including) the
+ * first occurrence of until.
+ */
+static std::string truncated(const std::string& t, const char *until) {
+  return t.substr(0, t.find(until));
+}
+
+struct Result {
+  // Identifications of the telegrams received, separated by spaces
+  std::string received;
+  unsigned overflows;
+  unsigned checksum_errors;
+  unsigned resyncs;
+};
+
+struct Case {
+  const char *name;
+  std::string stream;
+  Result normal;
+  Result streaming;
+};
+
+static Result run(const std::string& stream, bool streaming, size_t chunk) {
+  char buffer[BUFFER_SIZE];
+  P1Reader reader(NULL, 0, buffer, sizeof(buffer));
+  MyData data;
+  if (streaming)
+    reader.stream_into(&data);
+  reader.enable(false);
+
+  Result res = {};
+  const uint8_t *p = (const uint8_t*)stream.data();
+  size_t pos = 0;
+  while (pos < stream.size()) {
+    size_t n = stream.size() - pos < chunk ? stream.size() - pos : chunk;
+    pos += reader.feed(p + pos, n);
+    const char *sep = res.received.empty() ? "" : " ";
+    if (reader.available()) {
+      if (streaming || reader.parse(&data))
+        res.received += sep + data.identification;
+      else
+        res.received += sep + std::string("(parse error)");
+      reader.clear();
+      data.reset();
+    } else if (streaming && reader.stream_error()) {
+      res.received += sep + std::string("(parse error)");
+      reader.clear();
+    }
+  }
+  res.overflows = reader.stats().overflows;
+  res.checksum_errors = reader.stats().checksum_errors;
+  res.resyncs = reader.stats().resyncs;
+  return res;
+}
+
+static unsigned check(const Case& c, bool streaming, size_t chunk) {
+  const Result& want = streaming ? c.streaming : c.normal;
+  Result got = run(c.stream, streaming, chunk);
+  if (got.received == want.received && got.overflows == want.overflows &&
+      got.checksum_errors == want.checksum_errors && got.resyncs == want.resyncs)
+    return 0;
+  printf("%s (%s, %zu bytes at a time):\n", c.name, streaming ? "streaming" : "normal", chunk);
+  printf("  got      \"%s\", %u too long, %u checksum errors, %u resyncs\n",
+         got.received.c_str(), got.overflows, got.checksum_errors, got.resyncs);
+  printf("  expected \"%s\", %u too long, %u checksum errors, %u resyncs\n",
+         want.received.c_str(), want.overflows, want.checksum_errors, want.resyncs);
+  return 1;
+}
+
+int main() {
+  std::string a = telegram("A"), b = telegram("B");
+  // Fills the buffer exactly, so the / after it does not fit
+  std::string too_long = "/" + std::string(BUFFER_SIZE - 1, 'X');
+
+  const Case cases[] = {
+    {"clean", a + b,
+      {"A B", 0, 0, 0}, {"A B", 0, 0, 0}},
+    // The first line can contain a / (see below), so in streaming mode
+    // it is only restarted from once the checksum fails
+    {"truncated in the first line", truncated(a, "\r\n") + b,
+      {"B", 0, 1, 1}, {"B", 0, 1, 1}},
+    {"truncated in an id", truncated(a, ".8.1") + b,
+      {"B", 0, 1, 1}, {"B", 0, 0, 1}},
+    // In streaming mode, a line that does not end in ) can not contain
+    // a / in its value
+    {"truncated in a value", truncated(a, "671") + b,
+      {"B", 0, 1, 1}, {"B", 0, 0, 1}},
+    {"truncated before the !", truncated(a, "!") + b,
+      {"B", 0, 1, 1}, {"B", 0, 0, 1}},
+    {"truncated in the checksum", truncated(a, "\r\n!") + "\r\n!12" + b,
+      {"B", 0, 1, 1}, {"B", 0, 1, 1}},
+    {"/ in a value", telegram("A\r\n0-0:96.13.0(a/b)") + b,
+      {"A B", 0, 0, 0}, {"A B", 0, 0, 0}},
+    {"/ in the checksum", truncated(a, "\r\n!") + "\r\n!12/4\r\n" + b,
+      {"B", 0, 2, 2}, {"B", 0, 1, 2}},
+    {"/ in the first line", telegram("ISK5/2M550T") + b,
+      {"ISK5/2M550T B", 0, 0, 0}, {"ISK5/2M550T B", 0, 0, 0}},
+    {"// prefix", "/" + a + b,
+      {"A B", 0, 1, 1}, {"A B", 0, 1, 1}},
+    {"checksum mismatch", telegram("A", true) + b,
+      {"B", 0, 1, 0}, {"B", 0, 1, 0}},
+    {"garbage between telegrams", a + "garbage\r\n" + b,
+      {"A B", 0, 0, 0}, {"A B", 0, 0, 0}},
+    {"overflow followed by /", too_long + b,
+      {"B", 1, 0, 0}, {"B", 1, 0, 0}},
+    {"overflow followed by garbage", too_long + "garbage" + b,
+      {"B", 1, 0, 0}, {"B", 1, 0, 0}},
+    // Only the normal mode overflows, the first line alone still fits
+    {"overflow containing /", "/" + std::string(100, 'X') + b,
+      {"B", 1, 0, 1}, {"B", 0, 1, 1}},
+  };
+
+  unsigned bad = 0;
+  for (const Case& c : cases) {
+    for (bool streaming : {false, true}) {
+      bad += check(c, streaming, c.stream.size());
+      bad += check(c, streaming, 1);
+    }
+  }
+  printf("%u bad\n", bad);
+  return bad ? 1 : 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Checks skipping lines with errors (passing LineErrors) against
+ * P1Parser::parse() without skipping: Parsing the message normally,
+ * removing the line with the error and trying again until it parses
+ * must give the same errors (code, offset and id) and the same values
+ * as skipping the lines at once. This is checked for P1Parser::parse(),
+ * P1Parser::parse_fused(), P1Reader::parse() and the streaming mode of
+ * P1Reader, with and without unknown_error, for the sample messages
+ * with each of the broken lines from check.h, several of them at once
+ * and a wrong checksum (which is never skipped).
+ *
+ * Usage: dsmr-check-skip
+ *
+ * Prints every mismatch and exits with an error when there are any.
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "dsmr.h"
+#include "check.h"
+
+using MyData = CheckFields<ParsedData>;
+
+/**
+ * Returns the message for body, with a checksum that is one digit off
+ * when bad_crc is set.
+ */
+static std::string message(const std::string& body, bool bad_crc) {
+  std::string t = telegram(body);
+  if (bad_crc) {
+    char& digit = t[t.size() - 3];
+    digit = digit == '0' ? '1' : '0';
+  }
+  return t;
+}
+
+struct Result {
+  ParseError code;
+  std::vector<ParseErrorInfo> errors;
+  Values values;
+};
+
+static Result result(const ParseResult<void>& res, const LineErrors& skipped, MyData& data) {
+  Result r;
+  r.code = res.code;
+  for (size_t i = 0; i < skipped.stored(); ++i)
+    r.errors.push_back(skipped[i]);
+  if (!res.err)
+    r.values = values_of(data);
+  return r;
+}
+
+/**
+ * Parses the message body without skipping, removing the line with
+ * the error until it parses.
+ */
+static Result expected(std::string body, bool unknown_error, bool bad_crc) {
+  Result r;
+  size_t removed = 0;
+  while (true) {
+    std::string t = message(body, bad_crc);
+    MyData data;
+    ParseResult<void> res = P1Parser::parse(&data, t.data(), t.size(), unknown_error);
+    r.code = res.code;
+    if (!res.err) {
+      r.values = values_of(data);
+      return r;
+    }
+    // Errors from the ! onwards (like a wrong checksum) are not in a line
+    const char *start = t.data() + 1, *end = t.data() + t.size();
+    if (!res.ctx || res.ctx < start || res.ctx >= t.data() + t.rfind('!'))
+      return r;
+
+    ParseErrorInfo info(res, start, end);
+    size_t line_start = body.rfind('\n', info.offset) + 1;
+    size_t line_end = body.find('\n', info.offset) + 1;
+    info.offset += removed;
+    r.errors.push_back(info);
+    removed += line_end - line_start;
+    body.erase(line_start, line_end - line_start);
+  }
+}
+
+static unsigned compare(const std::string& what, const char *how, const Result& got, const Result& want) {
+  if (got.code != want.code) {
+    printf("%s (%s): got %s, expected %s\n", what.c_str(), how, code_str(got.code), code_str(want.code));
+    return 1;
+  }
+  bool same = got.errors.size() == want.errors.size();
+  for (size_t i = 0; same && i < want.errors.size(); ++i) {
+    const ParseErrorInfo &a = got.errors[i], &b = want.errors[i];
+    same = a.code == b.code && a.offset == b.offset && a.id == b.id;
+  }
+  if (!same) {
+    char buf[64];
+    printf("%s (%s): wrong lines skipped\n", what.c_str(), how);
+    for (const ParseErrorInfo& e : got.errors) {
+      e.render(buf, sizeof(buf));
+      printf("  got      %s\n", buf);
+    }
+    for (const ParseErrorInfo& e : want.errors) {
+      e.render(buf, sizeof(buf));
+      printf("  expected %s\n", buf);
+    }
+    return 1;
+  }
+  return same_values((what + " (" + how + ")").c_str(), got.values, want.values) ? 0 : 1;
+}
+
+static unsigned check(const std::string& what, const std::string& body, bool unknown_error, bool bad_crc = false) {
+  Result want = expected(body, unknown_error, bad_crc);
+  std::string t = message(body, bad_crc);
+
+  unsigned bad = 0;
+  MyData data;
+  StaticLineErrors<32> skipped;
+  ParseResult<void> res = P1Parser::parse(&data, t.data(), t.size(), unknown_error, &skipped);
+  bad += compare(what, "parse", result(res, skipped, data), want);
+
+  data.reset();
+  skipped.clear();
+  res = P1Parser::parse_fused(&data, t.data(), t.size(), unknown_error, &skipped);
+  bad += compare(what, "parse_fused", result(res, skipped, data), want);
+
+  // The reader does not pass unknown_error to parse()
+  if (!unknown_error) {
+    StaticP1Reader<1024> reader(NULL, 0);
+    reader.enable(false);
+    reader.feed((const uint8_t*)t.data(), t.size());
+    data.reset();
+    skipped.clear();
+    ParseErrorInfo err;
+    bool ok = reader.available() && reader.parse(&data, &err, &skipped);
+    res = ParseResult<void>();
+    if (!reader.stats().checksum_errors && !ok)
+      res.fail(err.code);
+    else if (!ok)
+      res.fail(ParseError::CHECKSUM_MISMATCH);
+    bad += compare(what, "P1Reader::parse", result(res, skipped, data), want);
+  }
+
+  StaticP1Reader<1024> stream_reader(NULL, 0);
+  data.reset();
+  skipped.clear();
+  stream_reader.stream_into(&data, unknown_error, &skipped);
+  stream_reader.enable(false);
+  stream_reader.feed((const uint8_t*)t.data(), t.size());
+  ParseErrorInfo err;
+  res = ParseResult<void>();
+  if (stream_reader.stream_error(&err))
+    res.fail(err.code);
+  else if (!stream_reader.available())
+    res.fail(ParseError::CHECKSUM_MISMATCH);
+  // Lines are skipped before the checksum is known, but forgotten when
+  // it is wrong
+  bad += compare(what, "streaming", result(res, skipped, data), want);
+  return bad;
+}
+
+int main() {
+  unsigned bad = 0;
+  char what[64];
+  for (size_t i = 0; i < lengthof(samples); ++i) {
+    for (bool unknown_error : {false, true}) {
+      const char *flags = unknown_error ? " (unknown_error)" : "";
+      snprintf(what, sizeof(what), "sample %zu%s", i, flags);
+      bad += check(what, samples[i], unknown_error);
+
+      std::string all = samples[i];
+      for (size_t j = 0; j < lengthof(broken_lines); ++j) {
+        snprintf(what, sizeof(what), "sample %zu, broken line %zu%s", i, j, flags);
+        bad += check(what, with_line(samples[i], broken_lines[j]), unknown_error);
+        // A line with the same id as an earlier one replaces it
+        all = with_line(all, broken_lines[j]);
+      }
+      snprintf(what, sizeof(what), "sample %zu, broken lines%s", i, flags);
+      bad += check(what, all, unknown_error);
+      snprintf(what, sizeof(what), "sample %zu, broken lines, wrong checksum%s", i, flags);
+      bad += check(what, all, unknown_error, true);
+    }
+  }
+  printf("%u bad\n", bad);
+  return bad ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Checks the slots of P1Reader (acquire() and release()) against
+ * P1Parser::parse(): Feeds the sample messages (as is and with each of
+ * the broken lines from check.h) to a reader with three slots and
+ * compares every message taken from it (its raw data, the error, the
+ * values and, when skipping lines, the lines skipped) with parsing the
+ * original message. This is done for:
+ *  - Acquiring every message and releasing them out of order, checking
+ *    that messages still held are not overwritten.
+ *  - Not acquiring any message, so only the last three are kept and
+ *    the others are dropped (see P1Reader::Stats::dropped).
+ *  - Receiving a message while all slots are acquired, which drops it.
+ *
+ * Usage: dsmr-check-slots
+ *
+ * Prints every mismatch and exits with an error when there are any.
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "dsmr.h"
+#include "check.h"
+
+using MyData = CheckFields<ParsedData>;
+
+static const uint8_t SLOTS = 3;
+using MyReader = StaticP1Reader<1024, SLOTS>;
+
+static void feed(MyReader& reader, const std::string& body) {
+  std::string t = telegram(body);
+  reader.feed((const uint8_t*)t.data(), t.size());
+}
+
+/**
+ * Compares the message taken from the reader with parsing its body
+ * using P1Parser::parse(). Returns 1 when they differ.
+ */
+static unsigned check_message(const std::string& what, const P1Message *msg, const std::string& body, bool skip) {
+  if (!msg) {
+    printf("%s: no message\n", what.c_str());
+    return 1;
+  }
+  if (std::string(msg->raw(), msg->raw_length()) != body) {
+    printf("%s: wrong raw data\n", what.c_str());
+    return 1;
+  }
+
+  std::string t = telegram(body);
+  const char *start = t.data() + 1, *end = t.data() + t.size();
+  StaticLineErrors<16> skipped;
+  MyData data;
+  ParseResult<void> res = P1Parser::parse(&data, t.data(), t.size(), false, skip ? &skipped : NULL);
+
+  StaticLineErrors<16> msg_skipped;
+  MyData msg_data;
+  ParseErrorInfo err;
+  bool ok = msg->parse(&msg_data, &err, skip ? &msg_skipped : NULL);
+
+  ParseErrorInfo want = res.err ? ParseErrorInfo(res, start, end) : ParseErrorInfo();
+  if (ok != !res.err || (!ok && (err.code != want.code || err.offset != want.offset))) {
+    printf("%s: got %s at %d, expected %s at %d\n", what.c_str(), code_str(ok ? ParseError::NONE : err.code),
+           ok ? -1 : err.offset, code_str(res.code), res.err ? want.offset : -1);
+    return 1;
+  }
+
+  bool same = msg_skipped.count() == skipped.count();
+  for (size_t i = 0; same && i < skipped.stored(); ++i)
+    same = msg_skipped[i].code == skipped[i].code && msg_skipped[i].offset == skipped[i].offset;
+  if (!same) {
+    printf("%s: %zu lines skipped, expected %zu (or different errors)\n", what.c_str(), msg_skipped.count(), skipped.count());
+    return 1;
+  }
+  return same_values(what.c_str(), values_of(msg_data), values_of(data)) ? 0 : 1;
+}
+
+static unsigned check_dropped(const std::string& what, MyReader& reader, uint32_t dropped) {
+  if (reader.stats().dropped == dropped)
+    return 0;
+  printf("%s: %u messages dropped, expected %u\n", what.c_str(), reader.stats().dropped, dropped);
+  return 1;
+}
+
+/**
+ * Acquires every message right after it is received and, when all
+ * slots are held, releases the middle one.
+ */
+static unsigned check_acquire(const std::string& what, const std::vector<std::string>& bodies, bool skip) {
+  MyReader reader(NULL, 0);
+  reader.enable(false);
+  std::vector<std::pair<P1Message*, size_t>> held;
+  unsigned bad = 0;
+  char name[96];
+  for (size_t i = 0; i < bodies.size(); ++i) {
+    feed(reader, bodies[i]);
+    snprintf(name, sizeof(name), "%s, message %zu", what.c_str(), i);
+    P1Message *msg = reader.acquire();
+    bad += check_message(name, msg, bodies[i], skip);
+    if (!msg)
+      continue;
+    held.push_back({msg, i});
+
+    if (held.size() == SLOTS) {
+      // Messages still held must not have been overwritten
+      for (const auto& h : held) {
+        snprintf(name, sizeof(name), "%s, message %zu (held)", what.c_str(), h.second);
+        bad += check_message(name, h.first, bodies[h.second], skip);
+      }
+      reader.release(held[SLOTS / 2].first);
+      held.erase(held.begin() + SLOTS / 2);
+    }
+  }
+  for (const auto& h : held) {
+    snprintf(name, sizeof(name), "%s, message %zu (held)", what.c_str(), h.second);
+    bad += check_message(name, h.first, bodies[h.second], skip);
+    reader.release(h.first);
+  }
+  return bad + check_dropped(what, reader, 0);
+}
+
+/**
+ * Receives all messages without acquiring them, so only the last ones
+ * are kept. Then receives another message while all slots are
+ * acquired.
+ */
+static unsigned check_drop(const std::string& what, const std::vector<std::string>& bodies, bool skip) {
+  MyReader reader(NULL, 0);
+  reader.enable(false);
+  for (const std::string& body : bodies)
+    feed(reader, body);
+
+  unsigned bad = check_dropped(what, reader, bodies.size() - SLOTS);
+  P1Message *held[SLOTS];
+  char name[96];
+  for (size_t i = 0; i < SLOTS; ++i) {
+    size_t n = bodies.size() - SLOTS + i;
+    snprintf(name, sizeof(name), "%s, message %zu", what.c_str(), n);
+    held[i] = reader.acquire();
+    bad += check_message(name, held[i], bodies[n], skip);
+  }
+
+  // No slot is free
+  feed(reader, bodies[0]);
+  bad += check_dropped(what + ", all acquired", reader, bodies.size() - SLOTS + 1);
+  if (reader.available()) {
+    printf("%s, all acquired: message available\n", what.c_str());
+    ++bad;
+  }
+
+  reader.release(held[SLOTS / 2]);
+  feed(reader, bodies[0]);
+  bad += check_message(what + ", message 0 (again)", reader.acquire(), bodies[0], skip);
+  for (size_t i = 0; i < SLOTS; ++i) {
+    if (i == SLOTS / 2)
+      continue;
+    snprintf(name, sizeof(name), "%s, message %zu (held)", what.c_str(), bodies.size() - SLOTS + i);
+    bad += check_message(name, held[i], bodies[bodies.size() - SLOTS + i], skip);
+  }
+  return bad;
+}
+
+int main() {
+  unsigned bad = 0;
+  char what[64];
+  for (size_t i = 0; i < lengthof(samples); ++i) {
+    std::vector<std::string> bodies = {samples[i]};
+    for (size_t j = 0; j < lengthof(broken_lines); ++j)
+      bodies.push_back(with_line(samples[i], broken_lines[j]));
+
+    for (bool skip : {false, true}) {
+      const char *flags = skip ? " (skipping)" : "";
+      snprintf(what, sizeof(what), "sample %zu, acquiring%s", i, flags);
+      bad += check_acquire(what, bodies, skip);
+      snprintf(what, sizeof(what), "sample %zu, dropping%s", i, flags);
+      bad += check_drop(what, bodies, skip);
+    }
+  }
+  printf("%u bad\n", bad);
+  return bad ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Checks TimestampValue::decode() against timegm() for every day from
+ * 2000 up to 2099 (and raw() against the original string). Checks that
+ * digits that are not a valid date (e.g. February 29th in a year that
+ * is not a leap year, or the placeholders some meters send) are kept
+ * but marked as not valid, and that malformed timestamps are rejected.
+ *
+ * Usage: dsmr-check-timestamp
+ *
+ * Prints every mismatch and exits with an error when there are any.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "dsmr.h"
+
+using MyData = ParsedData<
+  timestamp,
+  gas_delivered
+>;
+
+// Telegram with the placeholders that some meters send for timestamps
+static const char placeholders[] =
+  "/FLU5\\253769484_A\r\n"
+  "\r\n"
+  "0-0:1.0.0(000000000000W)\r\n"
+  "0-1:24.2.1(632525252525S)(00000.000*m3)\r\n"
+  "!";
+
+static unsigned bad = 0;
+
+// Expected results that are not a time
+static const time_t MALFORMED = -1;
+static const time_t NOT_VALID = -2;
+
+/**
+ * Checks that str decodes to the given UTC time (or is rejected, or
+ * marked as not valid), and that raw() gives str back.
+ */
+static void check(const char *str, time_t expected) {
+  TimestampValue ts;
+  bool ok = ts.decode(str);
+  if (!ok || expected == MALFORMED) {
+    if (ok != (expected != MALFORMED)) {
+      printf("%s: %s\n", str, ok ? "accepted" : "rejected");
+      bad++;
+    }
+    return;
+  }
+
+  char raw[14];
+  ts.raw(raw);
+  uint32_t epoch = expected == NOT_VALID ? 0 : expected;
+  if (ts.valid != (expected != NOT_VALID) || ts.epoch != epoch || strcmp(raw, str) != 0) {
+    printf("%s: got %lu (%s, %s), expected %lu (%s)\n", str, (unsigned long)ts.epoch, raw,
+           ts.valid ? "valid" : "not valid", (unsigned long)epoch, expected == NOT_VALID ? "not valid" : "valid");
+    bad++;
+  }
+}
+
+int main() {
+  static const uint8_t month_days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  char str[14];
+  for (int year = 0; year < 100; ++year) {
+    for (int month = 1; month <= 12; ++month) {
+      int days = month_days[month - 1] + (month == 2 && year % 4 == 0);
+      for (int day = 0; day <= 32; ++day) {
+        struct tm tm = {};
+        tm.tm_year = 100 + year;
+        tm.tm_mon = month - 1;
+        tm.tm_mday = day;
+        tm.tm_hour = 23;
+        tm.tm_min = 59;
+        tm.tm_sec = 58;
+        bool valid = day >= 1 && day <= days;
+        snprintf(str, sizeof(str), "%02d%02d%02d235958S", year, month, day);
+        check(str, valid ? timegm(&tm) - 7200 : NOT_VALID);
+        snprintf(str, sizeof(str), "%02d%02d%02d235958W", year, month, day);
+        check(str, valid ? timegm(&tm) - 3600 : NOT_VALID);
+      }
+    }
+  }
+
+  // Edge cases, spelled out
+  check("160229120000W", 1456743600);
+  check("150131120000W", 1422702000);
+  check("151231120000W", 1451559600);
+  static const char *const not_valid[] = {
+    "150229120000W", // 2015 is not a leap year
+    "160230120000W",
+    "150231120000W",
+    "150431120000W",
+    "150631120000W",
+    "150931120000W",
+    "151131120000W",
+    "150001120000W",
+    "151301120000W",
+    "150100120000W",
+    "150101240000W",
+    "150101126000W",
+    "150101120060W",
+    // Placeholders sent by some meters
+    "632525252525S",
+    "000000000000W",
+  };
+  for (const char *str : not_valid)
+    check(str, NOT_VALID);
+  static const char *const malformed[] = {
+    "150101120000X",
+    "15010112000AW",
+    "15010112000/W",
+  };
+  for (const char *str : malformed)
+    check(str, MALFORMED);
+
+  // Placeholders must not make the whole telegram fail
+  MyData data;
+  // Skip the / and stop at the ! (there is no checksum)
+  const char *end = placeholders + strlen(placeholders) - 1;
+  ParseResult<void> res = P1Parser::parse_data(&data, placeholders + 1, end);
+  char raw[14];
+  data.gas_delivered.timestamp.raw(raw);
+  if (res.err || !data.all_present() || data.timestamp.valid || data.gas_delivered.timestamp.valid ||
+      strcmp(raw, "632525252525S") != 0) {
+    printf("Telegram with placeholders: %s\n", res.err ? reinterpret_cast<const char*>(res.err) : "wrong values");
+    bad++;
+  }
+
+  printf("%u bad\n", bad);
+  return bad ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Shows the event API: Parses a P1 message and prints each field as
+ * it is parsed, without storing anything in a ParsedData object.
+*/
+
+#include <iostream>
+
+#include "dsmr.h"
+#include "printer.h"
+
+// Data to parse
+const char raw[] =
+  "/KFM5KAIFA-METER\r\n"
+  "\r\n"
+  "1-3:0.2.8(40)\r\n"
+  "0-0:1.0.0(150117185916W)\r\n"
+  "0-0:96.1.1(0000000000000000000000000000000000)\r\n"
+  "1-0:1.8.1(000671.578*kWh)\r\n"
+  "1-0:1.8.2(000842.472*kWh)\r\n"
+  "1-0:2.8.1(000000.000*kWh)\r\n"
+  "1-0:2.8.2(000000.000*kWh)\r\n"
+  "0-0:96.14.0(0001)\r\n"
+  "1-0:1.7.0(00.333*kW)\r\n"
+  "1-0:2.7.0(00.000*kW)\r\n"
+  "0-0:17.0.0(999.9*kW)\r\n"
+  "0-0:96.3.10(1)\r\n"
+  "0-0:96.7.21(00008)\r\n"
+  "0-0:96.7.9(00007)\r\n"
+  "1-0:99.97.0(1)(0-0:96.7.19)(000101000001W)(2147483647*s)\r\n"
+  "1-0:32.32.0(00000)\r\n"
+  "1-0:32.36.0(00000)\r\n"
+  "0-0:96.13.1()\r\n"
+  "0-0:96.13.0()\r\n"
+  "1-0:31.7.0(001*A)\r\n"
+  "1-0:21.7.0(00.332*kW)\r\n"
+  "1-0:22.7.0(00.000*kW)\r\n"
+  "0-1:24.1.0(003)\r\n"
+  "0-1:96.1.0(0000000000000000000000000000000000)\r\n"
+  "0-1:24.2.1(150117180000W)(00473.789*m3)\r\n"
+  "0-1:24.4.0(1)\r\n"
+  "!6F4A\r\n";
+
+struct EventPrinter : public ParseEventHandler {
+  template<typename F, typename V>
+  void on_field(const V& value) {
+    std::cout << to_str(F::get_name()) << ": ";
+    print_value(value);
+    std::cout << F::unit() << std::endl;
+  }
+
+  void on_unknown(const ObisId& id, const StringView& value) {
+    std::cout << "unknown " << (unsigned)id.v[0] << "-" << (unsigned)id.v[1] << ":"
+              << (unsigned)id.v[2] << "." << (unsigned)id.v[3] << "." << (unsigned)id.v[4] << ": ";
+    print_value(value);
+    std::cout << std::endl;
+  }
+
+  void on_error(const ParseResult<void>& res) {
+    std::cout << res.fullError(raw, raw + lengthof(raw)) << std::endl;
+  }
+};
+
+int main() {
+  // Only these fields are parsed, all other lines are reported as
+  // unknown
+  EventPrinter printer;
+  ParseResult<void> res = P1Parser::parse_events<
+    identification,
+    timestamp,
+    energy_delivered_tariff1,
+    energy_delivered_tariff2,
+    electricity_tariff,
+    power_delivered,
+    electricity_failure_log,
+    gas_delivered
+  >(raw, lengthof(raw), printer);
+  return res.err ? 1 : 0;
+}
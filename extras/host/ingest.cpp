@@ -0,0 +1,150 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Reads P1 messages from multiple meters at once (see ingest.h) and
+ * prints the parsed result of each message, prefixed by the name of the
+ * meter, to stdout.
+ *
+ * Usage: dsmr-ingest [-w workers] [-b size] [-n slots] source...
+ *
+ * Each source is either a tty (or fifo), or a host:port to connect to
+ * (e.g. a serial-to-TCP converter). With -w, the given number of
+ * worker threads parse the messages (default 2). -b and -n set the
+ * buffer size and number of slots of each reader (default 2048 and 2).
+ * When a source is closed, its number of errors is printed to stderr.
+ * This runs until all sources are closed.
+ *
+ * Note that a tty should be configured (baudrate, raw mode) before
+ * starting this, e.g. using stty.
+*/
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <iostream>
+#include <mutex>
+
+#include "dsmr.h"
+#include "ingest.h"
+#include "printer.h"
+
+using MyData = ParsedData<
+  /* String */ identification,
+  /* StaticString<2> */ p1_version,
+  /* TimestampValue */ timestamp,
+  /* String */ equipment_id,
+  /* FixedValue */ energy_delivered_tariff1,
+  /* FixedValue */ energy_delivered_tariff2,
+  /* FixedValue */ energy_returned_tariff1,
+  /* FixedValue */ energy_returned_tariff2,
+  /* StaticString<4> */ electricity_tariff,
+  /* FixedValue */ power_delivered,
+  /* FixedValue */ power_returned,
+  /* FixedValue */ voltage_l1,
+  /* FixedValue */ current_l1,
+  /* TimestampedFixedValue */ gas_delivered
+>;
+
+/**
+ * Opens a tty or fifo, or connects to host:port. Returns -1 on error.
+ */
+static int open_source(const std::string& source) {
+  size_t colon = source.rfind(':');
+  if (source[0] == '/' || colon == std::string::npos) {
+    int fd = open(source.c_str(), O_RDONLY | O_NOCTTY);
+    if (fd < 0)
+      perror(source.c_str());
+    return fd;
+  }
+
+  struct addrinfo hints = {}, *res;
+  hints.ai_socktype = SOCK_STREAM;
+  std::string host = source.substr(0, colon), port = source.substr(colon + 1);
+  int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+  if (err) {
+    std::cerr << source << ": " << gai_strerror(err) << std::endl;
+    return -1;
+  }
+  int fd = -1;
+  for (struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+    if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(res);
+  if (fd < 0)
+    perror(source.c_str());
+  return fd;
+}
+
+int main(int argc, char **argv) {
+  unsigned workers = 2;
+  size_t size = 2048;
+  unsigned long slots = 2;
+  int opt;
+  while ((opt = getopt(argc, argv, "w:b:n:")) != -1) {
+    if (opt == 'w') {
+      workers = strtoul(optarg, NULL, 0);
+    } else if (opt == 'b') {
+      size = strtoul(optarg, NULL, 0);
+    } else if (opt == 'n') {
+      slots = strtoul(optarg, NULL, 0);
+    } else {
+      optind = argc + 1;
+      break;
+    }
+  }
+  if (optind >= argc || workers < 1 || slots < 1 || slots > 255) {
+    std::cerr << "Usage: " << argv[0] << " [-w workers] [-b size] [-n slots] source..." << std::endl;
+    return 1;
+  }
+
+  // Workers print whole messages, so they do not get mixed up
+  std::mutex out;
+  IngestEngine engine([&out](const IngestEngine::Source& source, const P1Message& msg) {
+    MyData data;
+    ParseErrorInfo err;
+    bool ok = msg.parse(&data, &err);
+
+    std::lock_guard<std::mutex> lock(out);
+    std::cout << source.name << ":" << std::endl;
+    if (ok) {
+      data.applyEach(Printer());
+    } else {
+      char buf[80];
+      err.render(buf, sizeof(buf));
+      std::cout << buf << std::endl;
+    }
+    std::cout << std::endl;
+  }, workers, size, slots);
+
+  engine.on_close([&engine](IngestEngine::Source& source) {
+    const P1Reader::Stats& stats = source.reader.stats();
+    std::cerr << source.name << " closed: " << stats.overflows << " too long, "
+              << stats.checksum_errors << " checksum errors, "
+              << stats.dropped << " dropped" << std::endl;
+    // The source being closed is still counted
+    if (engine.size() == 1)
+      engine.stop();
+  });
+
+  for (int i = optind; i < argc; ++i) {
+    int fd = open_source(argv[i]);
+    if (fd < 0)
+      return 1;
+    if (!engine.add(fd, argv[i])) {
+      perror(argv[i]);
+      return 1;
+    }
+  }
+
+  engine.run();
+  return 0;
+}
@@ -0,0 +1,397 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Ingestion engine for the host examples, which reads P1 messages from
+ * many file descriptors at once using epoll (so Linux only) and parses
+ * them on a pool of worker threads.
+*/
+
+#ifndef DSMR_HOST_EXAMPLE_INGEST_H
+#define DSMR_HOST_EXAMPLE_INGEST_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "dsmr.h"
+
+/**
+ * Reads P1 messages from many file descriptors (ttys, sockets, pipes,
+ * but not regular files, which epoll does not support) at once.
+ *
+ * A single thread (the one calling run() or poll()) waits for data on
+ * all of them using epoll and feeds it into a separate P1Reader for
+ * each. Every complete message is taken from its reader using
+ * P1Reader::acquire() and handed to a pool of worker threads, that
+ * call the handler passed to the constructor (e.g. to parse it). The
+ * message is not copied: The worker passes it back to the I/O thread
+ * afterwards, which releases it. Meanwhile, the reader receives the
+ * next message into another slot. When all slots of a reader are still
+ * being handled, new messages from that source are dropped (counted in
+ * P1Reader::Stats::dropped), so slow handlers cannot make the engine
+ * use more memory.
+ *
+ * Sources are closed when their file descriptor reports end-of-file or
+ * an error. Except for stop(), all methods must be called from the I/O
+ * thread.
+ */
+class IngestEngine {
+  public:
+    /**
+     * A file descriptor that messages are read from.
+     */
+    struct Source {
+      // These do not change, so handlers can use them
+      int fd;
+      std::string name;
+      void *user;
+
+      // The rest is only used by the I/O thread
+      std::vector<char> buffer;
+      std::vector<P1Message> slots;
+      P1Reader reader;
+      // Messages handed to the workers, but not released yet
+      size_t pending = 0;
+      bool closed = false;
+
+      Source(int fd, const std::string& name, void *user, size_t size, uint8_t count)
+        : fd(fd), name(name), user(user), buffer(size * count), slots(count),
+          reader(NULL, 0, buffer.data(), buffer.size(), slots.data(), count) { }
+    };
+
+    /**
+     * Called from a worker thread for every complete message. The
+     * message (and the Source, apart from its reader) can be used
+     * until this returns.
+     */
+    typedef std::function<void(const Source& source, const P1Message& msg)> Handler;
+
+    /**
+     * Called from the I/O thread when a source reached end-of-file or
+     * an error, just before its file descriptor is closed (e.g. to
+     * collect the stats of its reader).
+     */
+    typedef std::function<void(Source& source)> CloseHandler;
+
+    struct Stats {
+      // Sources that are open
+      size_t sources;
+      uint64_t bytes;
+      // Messages handed to the workers
+      uint64_t messages;
+      // Messages handed to the workers and passed back
+      uint64_t handled;
+    };
+
+    /**
+     * Creates the engine and starts the given number of workers. Each
+     * source gets a buffer of slots slots of buffer_size bytes each.
+     * Throws std::system_error when the epoll instance or the eventfd
+     * used to wake it up cannot be created (e.g. when running out of
+     * file descriptors).
+     */
+    IngestEngine(Handler handler, unsigned workers, size_t buffer_size = 2048, uint8_t slots = 2)
+      : handler(handler), buffer_size(buffer_size), slot_count(slots) {
+      this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+      if (this->epoll_fd < 0)
+        throw std::system_error(errno, std::generic_category(), "epoll_create1");
+      this->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (this->wake_fd < 0) {
+        int err = errno;
+        ::close(this->epoll_fd);
+        throw std::system_error(err, std::generic_category(), "eventfd");
+      }
+      struct epoll_event ev = {};
+      ev.events = EPOLLIN;
+      ev.data.ptr = NULL;
+      if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->wake_fd, &ev) < 0) {
+        int err = errno;
+        ::close(this->wake_fd);
+        ::close(this->epoll_fd);
+        throw std::system_error(err, std::generic_category(), "epoll_ctl");
+      }
+
+      for (unsigned i = 0; i < workers; ++i)
+        this->workers.emplace_back(&IngestEngine::work, this);
+    }
+
+    /**
+     * Waits for the workers to handle all queued messages, then closes
+     * all sources.
+     */
+    ~IngestEngine() {
+      {
+        std::lock_guard<std::mutex> lock(this->jobs_mutex);
+        this->shutdown = true;
+      }
+      this->jobs_cond.notify_all();
+      for (std::thread& t : this->workers)
+        t.join();
+
+      for (std::unique_ptr<Source>& s : this->sources)
+        if (!s->closed)
+          ::close(s->fd);
+      ::close(this->wake_fd);
+      ::close(this->epoll_fd);
+    }
+
+    IngestEngine(const IngestEngine&) = delete;
+    IngestEngine& operator=(const IngestEngine&) = delete;
+
+    void on_close(CloseHandler handler) {
+      this->close_handler = handler;
+    }
+
+    /**
+     * Starts reading from the given file descriptor, which is made
+     * non-blocking and is closed by the engine. Returns NULL (with
+     * errno set, leaving the file descriptor open and its flags
+     * unchanged) when it cannot be read using epoll.
+     */
+    Source *add(int fd, const std::string& name, void *user = NULL) {
+      std::unique_ptr<Source> s(new Source(fd, name, user, this->buffer_size, this->slot_count));
+      s->reader.enable(false);
+
+      // Only change the flags once epoll accepted the file descriptor,
+      // so it is left untouched on failure
+      struct epoll_event ev = {};
+      ev.events = EPOLLIN;
+      ev.data.ptr = s.get();
+      if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        return NULL;
+      int flags = fcntl(fd, F_GETFL);
+      if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        int err = errno;
+        epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        errno = err;
+        return NULL;
+      }
+
+      this->sources.push_back(std::move(s));
+      this->open_count++;
+      return this->sources.back().get();
+    }
+
+    /**
+     * Waits up to timeout milliseconds (-1 for no limit) for data,
+     * processes it and returns the number of events handled (or -1 on
+     * error).
+     */
+    int poll(int timeout) {
+      struct epoll_event events[256];
+      int n = epoll_wait(this->epoll_fd, events, sizeof(events) / sizeof(*events), timeout);
+      if (n < 0)
+        return errno == EINTR ? 0 : -1;
+
+      bool released = false;
+      for (int i = 0; i < n; ++i) {
+        Source *s = (Source*)events[i].data.ptr;
+        if (s)
+          this->read_source(s);
+        else
+          released = true;
+      }
+      if (released)
+        this->release_handled();
+      return n;
+    }
+
+    /**
+     * Processes data until stop() is called.
+     */
+    void run() {
+      while (!this->stopped && this->poll(-1) >= 0)
+        /* nothing */;
+      this->stopped = false;
+    }
+
+    /**
+     * Makes run() return. Can be called from any thread (including a
+     * handler).
+     */
+    void stop() {
+      this->stopped = true;
+      this->wake();
+    }
+
+    /**
+     * Returns the number of open sources.
+     */
+    size_t size() const {
+      return this->open_count;
+    }
+
+    Stats stats() const {
+      return Stats { this->open_count, this->bytes, this->messages, this->handled };
+    }
+
+    /**
+     * Calls f for every source, including closed sources that still
+     * have messages being handled.
+     */
+    template<typename F>
+    void each(F f) const {
+      for (const std::unique_ptr<Source>& s : this->sources)
+        f(*s);
+    }
+
+  protected:
+    struct Job {
+      Source *source;
+      P1Message *msg;
+    };
+
+    void read_source(Source *s) {
+      // Read once per event (epoll is level-triggered), so a busy
+      // source cannot starve the others
+      char buf[4096];
+      ssize_t n = ::read(s->fd, buf, sizeof(buf));
+      if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+      if (n <= 0) {
+        // End-of-file, or an error (e.g. EIO from a pty whose other
+        // side was closed)
+        this->close_source(s);
+        return;
+      }
+
+      this->bytes += n;
+      const uint8_t *data = (const uint8_t*)buf;
+      size_t pos = 0;
+      while (pos < (size_t)n) {
+        pos += s->reader.feed(data + pos, n - pos);
+        if (s->reader.available())
+          this->submit(s, s->reader.acquire());
+      }
+    }
+
+    void close_source(Source *s) {
+      if (this->close_handler)
+        this->close_handler(*s);
+      epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+      ::close(s->fd);
+      s->closed = true;
+      this->open_count--;
+      this->remove_if_done(s);
+    }
+
+    void remove_if_done(Source *s) {
+      if (!s->closed || s->pending)
+        return;
+      for (size_t i = 0; i < this->sources.size(); ++i) {
+        if (this->sources[i].get() == s) {
+          std::swap(this->sources[i], this->sources.back());
+          this->sources.pop_back();
+          return;
+        }
+      }
+    }
+
+    void submit(Source *s, P1Message *msg) {
+      s->pending++;
+      this->messages++;
+      {
+        std::lock_guard<std::mutex> lock(this->jobs_mutex);
+        this->jobs.push_back(Job { s, msg });
+      }
+      this->jobs_cond.notify_one();
+    }
+
+    /**
+     * Releases the messages that the workers are done with, on the I/O
+     * thread (P1Reader is not thread-safe).
+     */
+    void release_handled() {
+      // The eventfd is only used to wake up, its count does not matter
+      uint64_t count;
+      ssize_t n = ::read(this->wake_fd, &count, sizeof(count));
+      (void)n;
+
+      std::vector<Job> done;
+      {
+        std::lock_guard<std::mutex> lock(this->done_mutex);
+        done.swap(this->done);
+      }
+      for (const Job& job : done) {
+        job.source->reader.release(job.msg);
+        job.source->pending--;
+        this->handled++;
+        this->remove_if_done(job.source);
+      }
+    }
+
+    void wake() {
+      // This can only fail when the counter is about to overflow, in
+      // which case the I/O thread is woken up already
+      uint64_t one = 1;
+      ssize_t n = ::write(this->wake_fd, &one, sizeof(one));
+      (void)n;
+    }
+
+    void work() {
+      while (true) {
+        Job job;
+        {
+          std::unique_lock<std::mutex> lock(this->jobs_mutex);
+          this->jobs_cond.wait(lock, [this] { return this->shutdown || !this->jobs.empty(); });
+          if (this->jobs.empty())
+            return;
+          job = this->jobs.front();
+          this->jobs.pop_front();
+        }
+
+        this->handler(*job.source, *job.msg);
+
+        bool was_empty;
+        {
+          std::lock_guard<std::mutex> lock(this->done_mutex);
+          was_empty = this->done.empty();
+          this->done.push_back(job);
+        }
+        // Only wake the I/O thread once for a batch of messages
+        if (was_empty)
+          this->wake();
+      }
+    }
+
+    Handler handler;
+    CloseHandler close_handler;
+    size_t buffer_size;
+    uint8_t slot_count;
+    int epoll_fd;
+    // Written by the workers (and stop()) to wake up the I/O thread
+    int wake_fd;
+    std::atomic<bool> stopped{false};
+
+    std::vector<std::unique_ptr<Source>> sources;
+    size_t open_count = 0;
+    uint64_t bytes = 0;
+    uint64_t messages = 0;
+    uint64_t handled = 0;
+
+    std::vector<std::thread> workers;
+    std::mutex jobs_mutex;
+    std::condition_variable jobs_cond;
+    std::deque<Job> jobs;
+    bool shutdown = false;
+    std::mutex done_mutex;
+    std::vector<Job> done;
+};
+
+#endif // DSMR_HOST_EXAMPLE_INGEST_H
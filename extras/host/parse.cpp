@@ -0,0 +1,123 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Host version of the parse example: Parses a P1 message and
+ * automatically prints the result to stdout.
+*/
+
+#include <iostream>
+
+#include "dsmr.h"
+#include "printer.h"
+
+// Data to parse
+const char raw[] =
+  "/KFM5KAIFA-METER\r\n"
+  "\r\n"
+  "1-3:0.2.8(40)\r\n"
+  "0-0:1.0.0(150117185916W)\r\n"
+  "0-0:96.1.1(0000000000000000000000000000000000)\r\n"
+  "1-0:1.8.1(000671.578*kWh)\r\n"
+  "1-0:1.8.2(000842.472*kWh)\r\n"
+  "1-0:2.8.1(000000.000*kWh)\r\n"
+  "1-0:2.8.2(000000.000*kWh)\r\n"
+  "0-0:96.14.0(0001)\r\n"
+  "1-0:1.7.0(00.333*kW)\r\n"
+  "1-0:2.7.0(00.000*kW)\r\n"
+  "0-0:17.0.0(999.9*kW)\r\n"
+  "0-0:96.3.10(1)\r\n"
+  "0-0:96.7.21(00008)\r\n"
+  "0-0:96.7.9(00007)\r\n"
+  "1-0:99.97.0(1)(0-0:96.7.19)(000101000001W)(2147483647*s)\r\n"
+  "1-0:32.32.0(00000)\r\n"
+  "1-0:32.36.0(00000)\r\n"
+  "0-0:96.13.1()\r\n"
+  "0-0:96.13.0()\r\n"
+  "1-0:31.7.0(001*A)\r\n"
+  "1-0:21.7.0(00.332*kW)\r\n"
+  "1-0:22.7.0(00.000*kW)\r\n"
+  "0-1:24.1.0(003)\r\n"
+  "0-1:96.1.0(0000000000000000000000000000000000)\r\n"
+  "0-1:24.2.1(150117180000W)(00473.789*m3)\r\n"
+  "0-1:24.4.0(1)\r\n"
+  "!6F4A\r\n";
+
+/**
+ * Define the data we're interested in, as well as the datastructure to
+ * hold the parsed data. This list shows all supported fields, remove
+ * any fields you are not using from the below list to make the parsing
+ * and printing code smaller.
+ * Each template argument below results in a field of the same name.
+ */
+using MyData = ParsedData<
+  /* String */ identification,
+  /* StaticString<2> */ p1_version,
+  /* TimestampValue */ timestamp,
+  /* String */ equipment_id,
+  /* FixedValue */ energy_delivered_tariff1,
+  /* FixedValue */ energy_delivered_tariff2,
+  /* FixedValue */ energy_returned_tariff1,
+  /* FixedValue */ energy_returned_tariff2,
+  /* StaticString<4> */ electricity_tariff,
+  /* FixedValue */ power_delivered,
+  /* FixedValue */ power_returned,
+  /* FixedValue */ electricity_threshold,
+  /* uint8_t */ electricity_switch_position,
+  /* uint32_t */ electricity_failures,
+  /* uint32_t */ electricity_long_failures,
+  /* String */ electricity_failure_log,
+  /* uint32_t */ electricity_sags_l1,
+  /* uint32_t */ electricity_sags_l2,
+  /* uint32_t */ electricity_sags_l3,
+  /* uint32_t */ electricity_swells_l1,
+  /* uint32_t */ electricity_swells_l2,
+  /* uint32_t */ electricity_swells_l3,
+  /* StaticString<16> */ message_short,
+  /* String */ message_long,
+  /* FixedValue */ voltage_l1,
+  /* FixedValue */ voltage_l2,
+  /* FixedValue */ voltage_l3,
+  /* FixedValue */ current_l1,
+  /* FixedValue */ current_l2,
+  /* FixedValue */ current_l3,
+  /* FixedValue */ power_delivered_l1,
+  /* FixedValue */ power_delivered_l2,
+  /* FixedValue */ power_delivered_l3,
+  /* FixedValue */ power_returned_l1,
+  /* FixedValue */ power_returned_l2,
+  /* FixedValue */ power_returned_l3,
+  /* uint16_t */ gas_device_type,
+  /* String */ gas_equipment_id,
+  /* uint8_t */ gas_valve_position,
+  /* TimestampedFixedValue */ gas_delivered,
+  /* uint16_t */ thermal_device_type,
+  /* String */ thermal_equipment_id,
+  /* uint8_t */ thermal_valve_position,
+  /* TimestampedFixedValue */ thermal_delivered,
+  /* uint16_t */ water_device_type,
+  /* String */ water_equipment_id,
+  /* uint8_t */ water_valve_position,
+  /* TimestampedFixedValue */ water_delivered,
+  /* uint16_t */ slave_device_type,
+  /* String */ slave_equipment_id,
+  /* uint8_t */ slave_valve_position,
+  /* TimestampedFixedValue */ slave_delivered
+>;
+
+int main() {
+  MyData data;
+  ParseResult<void> res = P1Parser::parse(&data, raw, lengthof(raw), true);
+  if (res.err) {
+    // Parsing error, show it
+    std::cout << res.fullError(raw, raw + lengthof(raw)) << std::endl;
+    return 1;
+  }
+
+  // Parsed succesfully, print all values
+  data.applyEach(Printer());
+  return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Printer for the host examples, the equivalent of the Printer used in
+ * the Arduino examples, but printing to stdout.
+*/
+
+#ifndef DSMR_HOST_EXAMPLE_PRINTER_H
+#define DSMR_HOST_EXAMPLE_PRINTER_H
+
+#include <iostream>
+
+#include "dsmr.h"
+
+// Print small integers as numbers, not characters
+inline void print_value(uint8_t v) { std::cout << (unsigned)v; }
+inline void print_value(const FixedValue& v) { std::cout << v._value / 1000.0; }
+inline void print_value(const TimestampValue& v) { char buf[14]; v.raw(buf); std::cout << buf; }
+inline void print_value(const TimestampedFixedValue& v) { print_value(static_cast<const FixedValue&>(v)); }
+inline void print_value(const StringView& v) { std::cout.write(v.data(), v.length()); }
+template <size_t N>
+void print_value(const StaticString<N>& v) { std::cout.write(v.c_str(), v.length()); }
+template <typename T>
+void print_value(const T& v) { std::cout << v; }
+
+inline const char *to_str(const __FlashStringHelper *s) {
+  return reinterpret_cast<const char *>(s);
+}
+
+struct Printer {
+  template<typename Item>
+  void apply(Item &i, bool present) {
+    if (present) {
+      std::cout << to_str(Item::get_name()) << ": ";
+      print_value(i.val());
+      std::cout << Item::unit() << std::endl;
+    }
+  }
+};
+
+#endif // DSMR_HOST_EXAMPLE_PRINTER_H
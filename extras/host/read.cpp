@@ -0,0 +1,247 @@
+/*
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and redistribution.
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *
+ * Host version of the read example: Reads P1 messages from a file,
+ * tty or stdin using P1Reader and prints the parsed result to stdout.
+ *
+ * Usage: dsmr-read [-s] [-b size] [-n slots] [file]
+ *
+ * With -s, the reader parses each line as soon as it is received
+ * (see P1Reader::stream_into()) rather than parsing the complete
+ * message afterwards. With -b, the reader uses a buffer of the given
+ * size (default 4096). With -n, that buffer is split into the given
+ * number of slots and messages are taken from the reader using
+ * P1Reader::acquire(). At the end, the number of messages discarded
+ * because they did not fit, the number of checksum errors, the number
+ * of times the reader resynchronized on a new message start and the
+ * number of messages dropped before they were handled are printed to
+ * stderr.
+ *
+ * Note that a tty should be configured (baudrate, raw mode) before
+ * starting this, e.g. using stty.
+*/
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <iostream>
+#include <vector>
+
+#include "dsmr.h"
+#include "printer.h"
+
+/**
+ * Define the data we're interested in, as well as the datastructure to
+ * hold the parsed data. This list shows all supported fields, remove
+ * any fields you are not using from the below list to make the parsing
+ * and printing code smaller.
+ * Each template argument below results in a field of the same name.
+ */
+using MyData = ParsedData<
+  /* String */ identification,
+  /* StaticString<2> */ p1_version,
+  /* TimestampValue */ timestamp,
+  /* String */ equipment_id,
+  /* FixedValue */ energy_delivered_tariff1,
+  /* FixedValue */ energy_delivered_tariff2,
+  /* FixedValue */ energy_returned_tariff1,
+  /* FixedValue */ energy_returned_tariff2,
+  /* StaticString<4> */ electricity_tariff,
+  /* FixedValue */ power_delivered,
+  /* FixedValue */ power_returned,
+  /* FixedValue */ electricity_threshold,
+  /* uint8_t */ electricity_switch_position,
+  /* uint32_t */ electricity_failures,
+  /* uint32_t */ electricity_long_failures,
+  /* String */ electricity_failure_log,
+  /* uint32_t */ electricity_sags_l1,
+  /* uint32_t */ electricity_sags_l2,
+  /* uint32_t */ electricity_sags_l3,
+  /* uint32_t */ electricity_swells_l1,
+  /* uint32_t */ electricity_swells_l2,
+  /* uint32_t */ electricity_swells_l3,
+  /* StaticString<16> */ message_short,
+  /* String */ message_long,
+  /* FixedValue */ voltage_l1,
+  /* FixedValue */ voltage_l2,
+  /* FixedValue */ voltage_l3,
+  /* FixedValue */ current_l1,
+  /* FixedValue */ current_l2,
+  /* FixedValue */ current_l3,
+  /* FixedValue */ power_delivered_l1,
+  /* FixedValue */ power_delivered_l2,
+  /* FixedValue */ power_delivered_l3,
+  /* FixedValue */ power_returned_l1,
+  /* FixedValue */ power_returned_l2,
+  /* FixedValue */ power_returned_l3,
+  /* uint16_t */ gas_device_type,
+  /* String */ gas_equipment_id,
+  /* uint8_t */ gas_valve_position,
+  /* TimestampedFixedValue */ gas_delivered,
+  /* uint16_t */ thermal_device_type,
+  /* String */ thermal_equipment_id,
+  /* uint8_t */ thermal_valve_position,
+  /* TimestampedFixedValue */ thermal_delivered,
+  /* uint16_t */ water_device_type,
+  /* String */ water_equipment_id,
+  /* uint8_t */ water_valve_position,
+  /* TimestampedFixedValue */ water_delivered,
+  /* uint16_t */ slave_device_type,
+  /* String */ slave_equipment_id,
+  /* uint8_t */ slave_valve_position,
+  /* TimestampedFixedValue */ slave_delivered
+>;
+
+/**
+ * Stream implementation that reads from a file descriptor. This only
+ * blocks when no data is buffered at all, so P1Reader::loop() can
+ * return when it is waiting for more data, just like on Arduino.
+ */
+class FdStream : public Stream {
+  public:
+    FdStream(int fd) : fd(fd) { }
+
+    int available() override {
+      fill();
+      return len - pos;
+    }
+
+    int read() override {
+      return available() ? buf[pos++] : -1;
+    }
+
+    size_t readBytes(char *buffer, size_t length) override {
+      size_t n = 0;
+      while (n < length && available()) {
+        size_t count = length - n < len - pos ? length - n : len - pos;
+        memcpy(buffer + n, buf + pos, count);
+        pos += count;
+        n += count;
+      }
+      return n;
+    }
+
+    int peek() override {
+      return available() ? buf[pos] : -1;
+    }
+
+    bool eof() {
+      return at_eof && pos == len;
+    }
+
+  protected:
+    void fill() {
+      if (at_eof || len == sizeof(buf))
+        return;
+
+      // Only block when there is nothing buffered
+      struct pollfd p = { fd, POLLIN, 0 };
+      if (pos != len && poll(&p, 1, 0) <= 0)
+        return;
+
+      if (pos == len)
+        pos = len = 0;
+
+      ssize_t n = ::read(fd, buf + len, sizeof(buf) - len);
+      if (n <= 0)
+        at_eof = true;
+      else
+        len += n;
+    }
+
+    int fd;
+    unsigned char buf[4096];
+    size_t pos = 0, len = 0;
+    bool at_eof = false;
+};
+
+int main(int argc, char **argv) {
+  bool streaming = false;
+  size_t size = 4096;
+  unsigned long slots = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "sb:n:")) != -1) {
+    if (opt == 's') {
+      streaming = true;
+    } else if (opt == 'b') {
+      size = strtoul(optarg, NULL, 0);
+    } else if (opt == 'n') {
+      slots = strtoul(optarg, NULL, 0);
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [-s] [-b size] [-n slots] [file]" << std::endl;
+      return 1;
+    }
+  }
+
+  if (slots < 1 || slots > 255) {
+    std::cerr << "Number of slots should be 1-255" << std::endl;
+    return 1;
+  }
+
+  int fd = STDIN_FILENO;
+  if (optind < argc) {
+    fd = open(argv[optind], O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+      perror(argv[optind]);
+      return 1;
+    }
+  }
+
+  FdStream stream(fd);
+  // There is no request pin on the host, so the pin number is unused
+  std::vector<char> buffer(size);
+  std::vector<P1Message> messages(slots);
+  P1Reader reader(&stream, 0, buffer.data(), buffer.size(), messages.data(), messages.size());
+  MyData streamed;
+  if (streaming)
+    reader.stream_into(&streamed);
+  reader.enable(false);
+
+  while (true) {
+    ParseErrorInfo err;
+    reader.loop();
+
+    if (streaming && reader.available()) {
+      streamed.applyEach(Printer());
+      std::cout << std::endl;
+      reader.clear();
+    } else if (streaming && reader.stream_error(&err)) {
+      char buf[80];
+      err.render(buf, sizeof(buf));
+      std::cout << buf << std::endl << std::endl;
+      reader.clear();
+    } else if (reader.available()) {
+      MyData data;
+      // With a single slot, the message could also be parsed using
+      // reader.parse(), but the next message can only be received
+      // into another slot while this one is acquired
+      P1Message *msg = reader.acquire();
+      bool ok = msg->parse(&data, &err);
+      if (ok) {
+        // Parse succesful, print result
+        data.applyEach(Printer());
+      } else {
+        // Parser error, print error
+        char buf[80];
+        err.render(buf, sizeof(buf));
+        std::cout << buf << std::endl;
+      }
+      reader.release(msg);
+      std::cout << std::endl;
+    } else if (stream.eof()) {
+      // loop() only returns without a message when it processed all
+      // data read from the stream
+      break;
+    }
+  }
+
+  std::cerr << "Discarded (too long): " << reader.stats().overflows << std::endl;
+  std::cerr << "Checksum errors: " << reader.stats().checksum_errors << std::endl;
+  std::cerr << "Resynchronized: " << reader.stats().resyncs << std::endl;
+  std::cerr << "Dropped (not handled in time): " << reader.stats().dropped << std::endl;
+  return 0;
+}
@@ -35,6 +35,7 @@
 #include "dsmr/parser.h"
 #include "dsmr/reader.h"
 #include "dsmr/fields.h"
+#include "dsmr/registry.h"
 
 // Allow using everything without the namespace prefixes
 using namespace dsmr;
@@ -0,0 +1,328 @@
+/**
+ * Arduino DSMR parser.
+ *
+ * This software is licensed under the MIT License.
+ *
+ * Copyright (c) 2015 Matthijs Kooijman <matthijs@stdin.nl>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * CRC16 calculation. This uses the same CRC as _crc16_update from
+ * crc16.h (polynomial 0x8005, reflected, initial value 0), but offers
+ * faster implementations that process whole buffers at once.
+ *
+ * Which implementation is used is selected at compiletime through
+ * DSMR_CRC16_BACKEND, which can be set to one of:
+ *  - DSMR_CRC16_BITWISE: Process each byte bit by bit using
+ *    _crc16_update. Smallest code and no tables, this is the default
+ *    on AVR, where avr-libc has a hand-optimized assembly version.
+ *  - DSMR_CRC16_TABLE: Use a 256-entry lookup table (512 bytes,
+ *    stored in flash on MCUs). This is the default on other MCUs.
+ *  - DSMR_CRC16_SLICE8: Process 8 bytes at a time using 8 lookup
+ *    tables (4 kiB). This is the default on 64-bit little-endian hosts.
+ *  - DSMR_CRC16_PCLMUL: Use carry-less multiplication to fold 16 bytes
+ *    at a time, if the CPU supports it (checked at runtime), falling
+ *    back to slice-by-8 otherwise and for short buffers. This is the
+ *    default on x86_64 with gcc or clang.
+ */
+
+#ifndef DSMR_INCLUDE_CRC_H
+#define DSMR_INCLUDE_CRC_H
+
+#include "util.h"
+#include "crc16.h"
+
+#define DSMR_CRC16_BITWISE 1
+#define DSMR_CRC16_TABLE 2
+#define DSMR_CRC16_SLICE8 3
+#define DSMR_CRC16_PCLMUL 4
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && UINTPTR_MAX > 0xffffffff
+#define DSMR_CRC16_HAVE_SLICE8
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DSMR_CRC16_HAVE_PCLMUL
+#include <immintrin.h>
+#endif
+
+#ifndef DSMR_CRC16_BACKEND
+  #if defined(ARDUINO_ARCH_AVR)
+    #define DSMR_CRC16_BACKEND DSMR_CRC16_BITWISE
+  #elif defined(DSMR_CRC16_HAVE_PCLMUL)
+    #define DSMR_CRC16_BACKEND DSMR_CRC16_PCLMUL
+  #elif defined(DSMR_CRC16_HAVE_SLICE8)
+    #define DSMR_CRC16_BACKEND DSMR_CRC16_SLICE8
+  #else
+    #define DSMR_CRC16_BACKEND DSMR_CRC16_TABLE
+  #endif
+#endif
+
+#if DSMR_CRC16_BACKEND == DSMR_CRC16_SLICE8 && !defined(DSMR_CRC16_HAVE_SLICE8)
+#error "DSMR_CRC16_SLICE8 needs a 64-bit little-endian platform"
+#endif
+#if DSMR_CRC16_BACKEND == DSMR_CRC16_PCLMUL && !defined(DSMR_CRC16_HAVE_PCLMUL)
+#error "DSMR_CRC16_PCLMUL needs x86_64 and gcc or clang"
+#endif
+
+namespace dsmr {
+
+namespace crc16 {
+
+// Compiletime versions of the CRC calculation, used to generate the
+// lookup tables. These are recursive, since C++11 constexpr functions
+// cannot contain loops.
+
+// Process the given number of bits of crc
+constexpr uint16_t bits(uint16_t crc, uint8_t n) {
+  return n ? bits((crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1, n - 1) : crc;
+}
+
+// Process one zero byte
+constexpr uint16_t shift8(uint16_t crc) {
+  return (crc >> 8) ^ bits(crc & 0xff, 8);
+}
+
+// CRC of byte i, followed by n zero bytes
+constexpr uint16_t slice_entry(uint8_t n, uint8_t i) {
+  return n ? shift8(slice_entry(n - 1, i)) : bits(i, 8);
+}
+
+template <typename Seq = typename MakeIndexSequence<256>::type>
+struct Tables;
+
+template <size_t... Is>
+struct Tables<IndexSequence<Is...>> {
+  // Single table, indexed by (crc ^ byte) & 0xff
+  static constexpr uint16_t table[256] DSMR_PROGMEM = { slice_entry(0, Is)... };
+
+#ifdef DSMR_CRC16_HAVE_SLICE8
+  // Tables for slice-by-8, slice[n] handles a byte followed by n other
+  // bytes.
+  static constexpr uint16_t slice[8][256] = {
+    { slice_entry(0, Is)... },
+    { slice_entry(1, Is)... },
+    { slice_entry(2, Is)... },
+    { slice_entry(3, Is)... },
+    { slice_entry(4, Is)... },
+    { slice_entry(5, Is)... },
+    { slice_entry(6, Is)... },
+    { slice_entry(7, Is)... },
+  };
+#endif
+};
+
+template <size_t... Is>
+constexpr uint16_t Tables<IndexSequence<Is...>>::table[256];
+
+#ifdef DSMR_CRC16_HAVE_SLICE8
+template <size_t... Is>
+constexpr uint16_t Tables<IndexSequence<Is...>>::slice[8][256];
+#endif
+
+static inline uint16_t table_entry(uint8_t i) {
+#ifdef ARDUINO_ARCH_AVR
+  return pgm_read_word(&Tables<>::table[i]);
+#else
+  return Tables<>::table[i];
+#endif
+}
+
+#ifdef DSMR_CRC16_HAVE_PCLMUL
+// Polynomial arithmetic modulo P, on plain (non-reflected) polynomials.
+
+// a * x mod P
+constexpr uint32_t mulx_mod(uint32_t a) {
+  return (a & 0x8000) ? (a << 1) ^ 0x18005 : a << 1;
+}
+
+// a * b mod P, handling one bit of b at a time, starting at the top
+constexpr uint32_t mul_mod(uint32_t a, uint32_t b, int8_t bit = 15, uint32_t r = 0) {
+  return bit < 0 ? r : mul_mod(a, b, bit - 1, mulx_mod(r) ^ (((b >> bit) & 1) ? a : 0));
+}
+
+// x^n mod P, using square-and-multiply to limit the recursion depth
+constexpr uint32_t xpow_mod(uint16_t n) {
+  return n == 0 ? 1 : (n & 1) ? mulx_mod(xpow_mod(n - 1)) : mul_mod(xpow_mod(n / 2), xpow_mod(n / 2));
+}
+
+// Reflect the 16-bit polynomial p into a 64-bit value, putting the x^0
+// coefficient in bit 63.
+constexpr uint64_t reflect64(uint32_t p, uint8_t bit = 0) {
+  return bit == 16 ? 0 : (((uint64_t)((p >> bit) & 1) << (63 - bit)) | reflect64(p, bit + 1));
+}
+
+// Folding constant to multiply a 64-bit half of the folding state by,
+// to move it n bits further. The carry-less product of two reflected
+// values is one bit short, so this uses x^(n-1) to compensate.
+constexpr uint64_t fold_constant(uint16_t n) {
+  return reflect64(xpow_mod(n - 1));
+}
+#endif // DSMR_CRC16_HAVE_PCLMUL
+
+} // namespace crc16
+
+/**
+ * Update the CRC with a single byte. This is the same as
+ * _crc16_update, but using the selected backend.
+ */
+static inline uint16_t crc16_update(uint16_t crc, uint8_t data) {
+#if DSMR_CRC16_BACKEND == DSMR_CRC16_BITWISE
+  return _crc16_update(crc, data);
+#else
+  return (crc >> 8) ^ crc16::table_entry((crc ^ data) & 0xff);
+#endif
+}
+
+/**
+ * Update the CRC with n bytes of data, one bit at a time.
+ */
+static inline uint16_t crc16_update_bitwise(uint16_t crc, const char *data, size_t n) {
+  while (n--)
+    crc = _crc16_update(crc, *data++);
+  return crc;
+}
+
+/**
+ * Update the CRC with n bytes of data, one byte at a time using a
+ * lookup table.
+ */
+static inline uint16_t crc16_update_table(uint16_t crc, const char *data, size_t n) {
+  while (n--)
+    crc = (crc >> 8) ^ crc16::table_entry((crc ^ (uint8_t)*data++) & 0xff);
+  return crc;
+}
+
+#ifdef DSMR_CRC16_HAVE_SLICE8
+/**
+ * Update the CRC with n bytes of data, eight bytes at a time.
+ */
+static inline uint16_t crc16_update_slice8(uint16_t crc, const char *data, size_t n) {
+  typedef crc16::Tables<> T;
+  while (n >= 8) {
+    uint64_t w;
+    memcpy(&w, data, sizeof(w));
+    w ^= crc;
+    crc = T::slice[7][w & 0xff] ^
+          T::slice[6][(w >> 8) & 0xff] ^
+          T::slice[5][(w >> 16) & 0xff] ^
+          T::slice[4][(w >> 24) & 0xff] ^
+          T::slice[3][(w >> 32) & 0xff] ^
+          T::slice[2][(w >> 40) & 0xff] ^
+          T::slice[1][(w >> 48) & 0xff] ^
+          T::slice[0][w >> 56];
+    data += 8;
+    n -= 8;
+  }
+  return crc16_update_table(crc, data, n);
+}
+#endif // DSMR_CRC16_HAVE_SLICE8
+
+#ifdef DSMR_CRC16_HAVE_PCLMUL
+namespace crc16 {
+
+// Multiply both halves of x by the corresponding folding constants in
+// k and add them together, moving x further along the message.
+__attribute__((target("pclmul"))) static inline __m128i fold(__m128i x, __m128i k) {
+  return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11));
+}
+
+__attribute__((target("pclmul"))) static inline uint16_t update_pclmul(uint16_t crc, const char *data, size_t n) {
+  // Registers are loaded little-endian, so the low half contains the
+  // highest-order coefficients and must be moved furthest. Use
+  // constexpr variables to make sure these are calculated at
+  // compiletime.
+  constexpr uint64_t k128_lo = fold_constant(128 + 64), k128_hi = fold_constant(128);
+  constexpr uint64_t k512_lo = fold_constant(512 + 64), k512_hi = fold_constant(512);
+  const __m128i k128 = _mm_set_epi64x(k128_hi, k128_lo);
+  const __m128i k512 = _mm_set_epi64x(k512_hi, k512_lo);
+  const __m128i *p = reinterpret_cast<const __m128i*>(data);
+
+  // The initial CRC is simply added to the first 16 bits of the message
+  __m128i x = _mm_xor_si128(_mm_loadu_si128(p++), _mm_cvtsi32_si128(crc));
+  n -= 16;
+
+  if (n >= 64) {
+    // Fold four independent 16-byte lanes at a time, to hide the
+    // latency of the multiplications.
+    __m128i x1 = _mm_loadu_si128(p++);
+    __m128i x2 = _mm_loadu_si128(p++);
+    __m128i x3 = _mm_loadu_si128(p++);
+    n -= 48;
+    while (n >= 64) {
+      x = _mm_xor_si128(fold(x, k512), _mm_loadu_si128(p++));
+      x1 = _mm_xor_si128(fold(x1, k512), _mm_loadu_si128(p++));
+      x2 = _mm_xor_si128(fold(x2, k512), _mm_loadu_si128(p++));
+      x3 = _mm_xor_si128(fold(x3, k512), _mm_loadu_si128(p++));
+      n -= 64;
+    }
+    x = _mm_xor_si128(fold(x, k128), x1);
+    x = _mm_xor_si128(fold(x, k128), x2);
+    x = _mm_xor_si128(fold(x, k128), x3);
+  }
+
+  while (n >= 16) {
+    x = _mm_xor_si128(fold(x, k128), _mm_loadu_si128(p++));
+    n -= 16;
+  }
+
+  // x is now congruent to the message processed so far, so its CRC
+  // (starting from zero) is the CRC of that message.
+  char buf[16];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(buf), x);
+  crc = crc16_update_slice8(0, buf, sizeof(buf));
+  return crc16_update_slice8(crc, reinterpret_cast<const char*>(p), n);
+}
+
+} // namespace crc16
+
+/**
+ * Update the CRC with n bytes of data, using the carry-less multiply
+ * (PCLMULQDQ) instruction when the CPU supports it. Short buffers and
+ * CPUs without PCLMULQDQ use slice-by-8 instead.
+ */
+static inline uint16_t crc16_update_pclmul(uint16_t crc, const char *data, size_t n) {
+  if (n >= 32 && __builtin_cpu_supports("pclmul"))
+    return crc16::update_pclmul(crc, data, n);
+  return crc16_update_slice8(crc, data, n);
+}
+#endif // DSMR_CRC16_HAVE_PCLMUL
+
+/**
+ * Update the CRC with n bytes of data, using the selected backend.
+ */
+static inline uint16_t crc16_update(uint16_t crc, const char *data, size_t n) {
+#if DSMR_CRC16_BACKEND == DSMR_CRC16_BITWISE
+  return crc16_update_bitwise(crc, data, n);
+#elif DSMR_CRC16_BACKEND == DSMR_CRC16_TABLE
+  return crc16_update_table(crc, data, n);
+#elif DSMR_CRC16_BACKEND == DSMR_CRC16_SLICE8
+  return crc16_update_slice8(crc, data, n);
+#elif DSMR_CRC16_BACKEND == DSMR_CRC16_PCLMUL
+  return crc16_update_pclmul(crc, data, n);
+#else
+#error "Unknown DSMR_CRC16_BACKEND"
+#endif
+}
+
+} // namespace dsmr
+
+#endif // DSMR_INCLUDE_CRC_H
@@ -34,8 +34,47 @@
 #include "util.h"
 #include "parser.h"
 
+// When DSMR_STRING_VIEWS is defined to 1, the string fields below
+// (e.g. equipment_id, message_long, electricity_failure_log) store a
+// StringView that points into the parsed buffer, instead of a copy of
+// the string. This saves copying and allocating, but the values are
+// only valid as long as that buffer is unchanged:
+//  - For P1Parser::parse, until the caller changes or frees the
+//    string it passed.
+//  - For P1Reader::parse, until the next call to loop() or feed().
+//  - Streaming mode (P1Reader::stream_into) does not support this,
+//    since it keeps only the current line (this fails to compile).
+// Call materialize() on a value to get a String copy that stays valid.
+#ifndef DSMR_STRING_VIEWS
+#define DSMR_STRING_VIEWS 0
+#endif
+
+// String fields that are at most this long are stored inline in a
+// StaticString, instead of in a (heap-allocated) String. This
+// keeps ParsedData free of heap memory for short fields. Define to 0
+// to always use String.
+#ifndef DSMR_STATIC_STRING_MAX
+#define DSMR_STATIC_STRING_MAX 16
+#endif
+
 namespace dsmr {
 
+#if DSMR_STRING_VIEWS
+typedef StringView FieldString;
+#else
+typedef String FieldString;
+#endif
+
+/**
+ * The type used to store a string of at most maxlen characters that
+ * would otherwise be stored as V: a StaticString when V is String and
+ * maxlen is small enough, V otherwise.
+ */
+template <size_t maxlen, typename V = FieldString>
+struct StringStorage {
+  typedef typename Conditional<IsSame<V, String>::value && maxlen <= DSMR_STATIC_STRING_MAX, StaticString<maxlen>, V>::type type;
+};
+
 /**
  * Superclass for data items in a P1 message.
  */
@@ -47,26 +86,217 @@ struct ParsedField {
   }
   // By defaults, fields have no unit
   static const char *unit() { return ""; }
+  // The type actually used to store a value declared (in
+  // DEFINE_FIELD) as V. By default, this is just V.
+  template <typename V>
+  using ValueType = V;
+  // The type used to pass a value declared as V without copying it
+  // (see P1Parser::parse_events). By default, this is just V.
+  template <typename V>
+  using ViewType = V;
 };
 
 template <typename T, size_t minlen, size_t maxlen>
 struct StringField : ParsedField<T> {
-  ParseResult<void> parse(const char *str, const char *end) {
-    ParseResult<String> res = StringParser::parse_string(minlen, maxlen, str, end);
+  template <typename V>
+  using ValueType = typename StringStorage<maxlen, V>::type;
+  template <typename V>
+  using ViewType = StringView;
+
+  template <typename V>
+  static ParseResult<void> parse_value(V& v, const char *str, const char *end) {
+    ParseResult<StringView> res = StringParser::parse_view(minlen, maxlen, str, end);
     if (!res.err)
-      static_cast<T*>(this)->val() = res.result;
+      assign_string(v, res.result);
     return res;
   }
+
+  ParseResult<void> parse(const char *str, const char *end) {
+    return parse_value(static_cast<T*>(this)->val(), str, end);
+  }
+};
+
+// A timestamp is sent as a string using YYMMDDhhmmssX format, in local
+// (Central European) time, where X is W or S for wintertime (UTC+1) or
+// summertime (UTC+2). Using the X flag, this is converted into a UNIX
+// timestamp (seconds since 1970-01-01 00:00 UTC), which fits in 32 bits
+// until 2106 and can be compared, sorted and subtracted directly.
+// Some meters send digits that are not a date instead (e.g. Belgian
+// meters send 632525252525S for an M-Bus channel without a meter), those
+// are kept as-is and marked as not valid.
+struct TimestampValue
+#ifdef ARDUINO
+  : public Printable
+#endif
+{
+  TimestampValue() : epoch(0), dst(false), valid(false), parts() { }
+
+  /**
+   * Returns the number of seconds since 1970-01-01 00:00 for the given
+   * date and time. Only valid for 1970 up to 2105.
+   */
+  static constexpr uint32_t make_epoch(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second) {
+    return days_from_civil(year, month, day) * 86400UL + hour * 3600UL + minute * 60UL + second;
+  }
+
+  /**
+   * Returns the number of days since 1970-01-01 for the given date.
+   * Years start at March 1st internally, so the leap day is the last
+   * day of the year.
+   */
+  static constexpr uint32_t days_from_civil(uint16_t year, uint8_t month, uint8_t day) {
+    return days_from_march(year - (month <= 2), month > 2 ? month - 3 : month + 9, day);
+  }
+
+  /**
+   * Offset of the local time used in the message from UTC, in seconds.
+   */
+  constexpr uint32_t utc_offset() const { return dst ? 7200 : 3600; }
+
+  /**
+   * The timestamp in local time (as sent in the message), in seconds
+   * since 1970-01-01 00:00.
+   */
+  constexpr uint32_t local() const { return epoch + utc_offset(); }
+
+  /**
+   * Parses a YYMMDDhhmmssX timestamp (exactly 13 characters). Returns
+   * false, leaving this value unchanged, when it does not consist of
+   * 12 digits followed by W or S. When the digits are not a valid date
+   * and time, this returns true but sets valid to false and epoch to 0
+   * (raw() still returns the original digits).
+   */
+  bool decode(const char *str) {
+    // Convert and check all digits without branching on each one
+    uint8_t d[12];
+    uint8_t bad = 0;
+    for (uint8_t i = 0; i < 12; ++i) {
+      d[i] = str[i] - '0';
+      bad |= d[i] > 9;
+    }
+    uint8_t year = d[0] * 10 + d[1];
+    uint8_t month = d[2] * 10 + d[3];
+    uint8_t day = d[4] * 10 + d[5];
+    uint8_t hour = d[6] * 10 + d[7];
+    uint8_t minute = d[8] * 10 + d[9];
+    uint8_t second = d[10] * 10 + d[11];
+    // Months alternate between 31 and 30 days, restarting in August.
+    // Every year divisible by 4 is a leap year from 2000 up to 2099.
+    uint8_t month_days = month == 2 ? 28 + (year % 4 == 0) : 30 + ((month + (month > 7)) & 1);
+    bad |= (str[12] != 'W') & (str[12] != 'S');
+    if (bad)
+      return false;
+
+    uint8_t invalid = (uint8_t)(month - 1) > 11;
+    invalid |= (uint8_t)(day - 1) >= month_days;
+    invalid |= (hour > 23) | (minute > 59) | (second > 59);
+    this->dst = str[12] == 'S';
+    this->valid = !invalid;
+    if (invalid) {
+      uint8_t parts[] = {year, month, day, hour, minute, second};
+      memcpy(this->parts, parts, sizeof(parts));
+      this->epoch = 0;
+    } else {
+      this->epoch = make_epoch(2000 + year, month, day, hour, minute, second) - utc_offset();
+    }
+    return true;
+  }
+
+  /**
+   * Writes the timestamp in the original YYMMDDhhmmssX format, followed
+   * by a NUL byte, to buf (which must have room for 14 bytes).
+   */
+  void raw(char *buf) const {
+    if (!valid) {
+      write_parts(buf, this->parts);
+      return;
+    }
+
+    uint32_t t = local();
+    uint32_t days = t / 86400;
+    uint32_t secs = t % 86400;
+
+    // Inverse of days_from_civil
+    uint32_t z = days + 719468;
+    uint32_t era = z / 146097;
+    uint32_t doe = z - era * 146097;
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+    uint8_t day = doy - (153 * mp + 2) / 5 + 1;
+    uint8_t month = mp < 10 ? mp + 3 : mp - 9;
+    uint16_t year = yoe + era * 400 + (month <= 2);
+
+    uint8_t parts[] = {(uint8_t)(year % 100), month, day, (uint8_t)(secs / 3600), (uint8_t)(secs / 60 % 60), (uint8_t)(secs % 60)};
+    write_parts(buf, parts);
+  }
+
+#ifdef ARDUINO
+  size_t printTo(Print& p) const {
+    char buf[14];
+    raw(buf);
+    return p.write(buf, 13);
+  }
+#endif
+
+  uint32_t epoch;
+  bool dst;
+  // False when the digits were not a valid date and time, in which case
+  // epoch is 0
+  bool valid;
+
+  private:
+    // The YY, MM, DD, hh, mm and ss numbers, only used when not valid
+    uint8_t parts[6];
+
+    void write_parts(char *buf, const uint8_t *parts) const {
+      for (uint8_t i = 0; i < 6; ++i) {
+        buf[2 * i] = '0' + parts[i] / 10;
+        buf[2 * i + 1] = '0' + parts[i] % 10;
+      }
+      buf[12] = dst ? 'S' : 'W';
+      buf[13] = '\0';
+    }
+
+    static constexpr uint32_t days_from_march(uint16_t year, uint8_t month, uint8_t day) {
+      return 365UL * year + year / 4 - year / 100 + year / 400 + (153 * month + 2) / 5 + day - 1 - 719468UL;
+    }
 };
 
-// A timestamp is essentially a string using YYMMDDhhmmssX format (where
-// X is W or S for wintertime or summertime). Parsing this into a proper
-// (UNIX) timestamp is hard to do generically. Parsing it into a
-// single integer needs > 4 bytes top fit and isn't very useful (you
-// cannot really do any calculation with those values). So we just parse
-// into a string for now.
+/**
+ * Stores a timestamp string (of 13 characters) into a TimestampValue
+ * (decoding it) or into a string type (as-is). Returns false if the
+ * timestamp is malformed (see TimestampValue::decode()).
+ */
+static inline bool store_timestamp(TimestampValue& t, StringView v) {
+  return t.decode(v.data());
+}
+
+template <typename S>
+static inline bool store_timestamp(S& s, StringView v) {
+  assign_string(s, v);
+  return true;
+}
+
 template <typename T>
-struct TimestampField : StringField<T, 13, 13> { };
+struct TimestampField : ParsedField<T> {
+  template <typename V>
+  using ValueType = typename StringStorage<13, V>::type;
+  template <typename V>
+  using ViewType = typename Conditional<IsSame<V, TimestampValue>::value, TimestampValue, StringView>::type;
+
+  template <typename V>
+  static ParseResult<void> parse_value(V& v, const char *str, const char *end) {
+    ParseResult<StringView> res = StringParser::parse_view(13, 13, str, end);
+    if (!res.err && !store_timestamp(v, res.result))
+      res.fail(ParseError::INVALID_TIMESTAMP, res.result.data());
+    return res;
+  }
+
+  ParseResult<void> parse(const char *str, const char *end) {
+    return parse_value(static_cast<T*>(this)->val(), str, end);
+  }
+};
 
 // Value that is parsed as a three-decimal float, but stored as an
 // integer (by multiplying by 1000). Supports val() (or implicit cast to
@@ -90,48 +320,64 @@ struct FixedValue {
 // integer unit is passed as a template argument.
 template <typename T, const char *_unit, const char *_int_unit>
 struct FixedField : ParsedField<T> {
-  ParseResult<void> parse(const char *str, const char *end) {
+  template <typename V>
+  static ParseResult<void> parse_value(V& v, const char *str, const char *end) {
     ParseResult<uint32_t> res = NumParser::parse(3, _unit, str, end);
     if (!res.err)
-      static_cast<T*>(this)->val()._value = res.result;
+      v._value = res.result;
     return res;
   }
 
+  ParseResult<void> parse(const char *str, const char *end) {
+    return parse_value(static_cast<T*>(this)->val(), str, end);
+  }
+
   static const char *unit() { return _unit; }
   static const char *int_unit() { return _int_unit; }
 };
 
 struct TimestampedFixedValue : public FixedValue {
-  String timestamp;
+  TimestampValue timestamp;
 };
 
 // Some numerical values are prefixed with a timestamp. This is simply
 // both of them concatenated, e.g. 0-1:24.2.1(150117180000W)(00473.789*m3)
 template <typename T, const char *_unit, const char *_int_unit>
 struct TimestampedFixedField : public FixedField<T, _unit, _int_unit> {
-  ParseResult<void> parse(const char *str, const char *end) {
+  template <typename V>
+  static ParseResult<void> parse_value(V& v, const char *str, const char *end) {
     // First, parse timestamp
-    ParseResult<String> res = StringParser::parse_string(13, 13, str, end);
+    ParseResult<StringView> res = StringParser::parse_view(13, 13, str, end);
     if (res.err)
       return res;
 
-    static_cast<T*>(this)->val().timestamp = res.result;
+    if (!store_timestamp(v.timestamp, res.result))
+      return res.fail(ParseError::INVALID_TIMESTAMP, res.result.data());
 
     // Which is immediately followed by the numerical value
-    return FixedField<T, _unit, _int_unit>::parse(res.next, end);
+    return FixedField<T, _unit, _int_unit>::parse_value(v, res.next, end);
+  }
+
+  ParseResult<void> parse(const char *str, const char *end) {
+    return parse_value(static_cast<T*>(this)->val(), str, end);
   }
 };
 
 // A integer number is just represented as an integer.
 template <typename T, const char *_unit>
 struct IntField : ParsedField<T> {
-  ParseResult<void> parse(const char *str, const char *end) {
+  template <typename V>
+  static ParseResult<void> parse_value(V& v, const char *str, const char *end) {
     ParseResult<uint32_t> res = NumParser::parse(0, _unit, str, end);
     if (!res.err)
-      static_cast<T*>(this)->val() = res.result;
+      v = res.result;
     return res;
   }
 
+  ParseResult<void> parse(const char *str, const char *end) {
+    return parse_value(static_cast<T*>(this)->val(), str, end);
+  }
+
   static const char *unit() { return _unit; }
 };
 
@@ -139,11 +385,19 @@ struct IntField : ParsedField<T> {
 // parenthesis around it) is returned as a string.
 template <typename T>
 struct RawField : ParsedField<T> {
-  ParseResult<void> parse(const char *str, const char *end) {
-    // Just copy the string verbatim value without any parsing
-    concat_hack(static_cast<T*>(this)->val(), str, end - str);
+  template <typename V>
+  using ViewType = StringView;
+
+  template <typename V>
+  static ParseResult<void> parse_value(V& v, const char *str, const char *end) {
+    // Just store the string verbatim value without any parsing
+    assign_string(v, StringView(str, end - str));
     return ParseResult<void>().until(end);
   }
+
+  ParseResult<void> parse(const char *str, const char *end) {
+    return parse_value(static_cast<T*>(this)->val(), str, end);
+  }
 };
 
 namespace fields {
@@ -184,8 +438,7 @@ struct NameConverter {
 
 #define DEFINE_FIELD(fieldname, value_t, obis, field_t, field_args...) \
   struct fieldname : field_t<fieldname, ##field_args> { \
-    value_t fieldname; \
-    bool fieldname ## _present = false; \
+    ValueType<value_t> fieldname; \
     static constexpr ObisId id = obis; \
     static constexpr char name_progmem[] DSMR_PROGMEM = #fieldname; \
     /* name field is for compatibility with a __FlashStringHelper *name \
@@ -195,22 +448,22 @@ struct NameConverter {
      * name() and add deprecated get_name() that calls name(). */ \
     [[gnu::deprecated]] static constexpr NameConverter<dsmr::fields::fieldname> name = {}; \
     static const __FlashStringHelper *get_name() { return reinterpret_cast<const __FlashStringHelper*>(&name_progmem); } \
-    value_t& val() { return fieldname; } \
-    bool& present() { return fieldname ## _present; } \
+    ValueType<value_t>& val() { return fieldname; } \
+    typedef ViewType<value_t> view_type; \
   }
 
 /* Meter identification. This is not a normal field, but a
  * specially-formatted first line of the message */
-DEFINE_FIELD(identification, String, ObisId(255, 255, 255, 255, 255, 255), RawField);
+DEFINE_FIELD(identification, FieldString, ObisId(255, 255, 255, 255, 255, 255), RawField);
 
 /* Version information for P1 output */
-DEFINE_FIELD(p1_version, String, ObisId(1, 3, 0, 2, 8), StringField, 2, 2);
+DEFINE_FIELD(p1_version, FieldString, ObisId(1, 3, 0, 2, 8), StringField, 2, 2);
 
 /* Date-time stamp of the P1 message */
-DEFINE_FIELD(timestamp, String, ObisId(0, 0, 1, 0, 0), TimestampField);
+DEFINE_FIELD(timestamp, TimestampValue, ObisId(0, 0, 1, 0, 0), TimestampField);
 
 /* Equipment identifier */
-DEFINE_FIELD(equipment_id, String, ObisId(0, 0, 96, 1, 1), StringField, 0, 96);
+DEFINE_FIELD(equipment_id, FieldString, ObisId(0, 0, 96, 1, 1), StringField, 0, 96);
 
 /* Meter Reading electricity delivered to client (Tariff 1) in 0,001 kWh */
 DEFINE_FIELD(energy_delivered_tariff1, FixedValue, ObisId(1, 0, 1, 8, 1), FixedField, units::kWh, units::Wh);
@@ -224,7 +477,7 @@ DEFINE_FIELD(energy_returned_tariff2, FixedValue, ObisId(1, 0, 2, 8, 2), FixedFi
 /* Tariff indicator electricity. The tariff indicator can also be used
  * to switch tariff dependent loads e.g boilers. This is the
  * responsibility of the P1 user */
-DEFINE_FIELD(electricity_tariff, String, ObisId(0, 0, 96, 14, 0), StringField, 4, 4);
+DEFINE_FIELD(electricity_tariff, FieldString, ObisId(0, 0, 96, 14, 0), StringField, 4, 4);
 
 /* Actual electricity power delivered (+P) in 1 Watt resolution */
 DEFINE_FIELD(power_delivered, FixedValue, ObisId(1, 0, 1, 7, 0), FixedField, units::kW, units::W);
@@ -243,7 +496,7 @@ DEFINE_FIELD(electricity_failures, uint32_t, ObisId(0, 0, 96, 7, 21), IntField,
 DEFINE_FIELD(electricity_long_failures, uint32_t, ObisId(0, 0, 96, 7, 9), IntField, units::none);
 
 /* Power Failure Event Log (long power failures) */
-DEFINE_FIELD(electricity_failure_log, String, ObisId(1, 0, 99, 97, 0), RawField);
+DEFINE_FIELD(electricity_failure_log, FieldString, ObisId(1, 0, 99, 97, 0), RawField);
 
 /* Number of voltage sags in phase L1 */
 DEFINE_FIELD(electricity_sags_l1, uint32_t, ObisId(1, 0, 32, 32, 0), IntField, units::none);
@@ -261,10 +514,10 @@ DEFINE_FIELD(electricity_swells_l3, uint32_t, ObisId(1, 0, 72, 36, 0), IntField,
 
 /* Text message codes: numeric 8 digits (Note: Missing from 5.0 spec)
  * */
-DEFINE_FIELD(message_short, String, ObisId(0, 0, 96, 13, 1), StringField, 0, 16);
+DEFINE_FIELD(message_short, FieldString, ObisId(0, 0, 96, 13, 1), StringField, 0, 16);
 /* Text message max 2048 characters (Note: Spec says 1024 in comment and
  * 2048 in format spec, so we stick to 2048). */
-DEFINE_FIELD(message_long, String, ObisId(0, 0, 96, 13, 0), StringField, 0, 2048);
+DEFINE_FIELD(message_long, FieldString, ObisId(0, 0, 96, 13, 0), StringField, 0, 2048);
 
 /* Instantaneous voltage L1 in 0.1V resolution (Note: Spec says V
  * resolution in comment, but 0.1V resolution in format spec. Added in
@@ -305,7 +558,7 @@ DEFINE_FIELD(power_returned_l3, FixedValue, ObisId(1, 0, 62, 7, 0), FixedField,
 DEFINE_FIELD(gas_device_type, uint16_t, ObisId(0, GAS_MBUS_ID, 24, 1, 0), IntField, units::none);
 
 /* Equipment identifier (Gas) */
-DEFINE_FIELD(gas_equipment_id, String, ObisId(0, GAS_MBUS_ID, 96, 1, 0), StringField, 0, 96);
+DEFINE_FIELD(gas_equipment_id, FieldString, ObisId(0, GAS_MBUS_ID, 96, 1, 0), StringField, 0, 96);
 
 /* Valve position Gas (on/off/released) (Note: Removed in 4.0.7 / 4.2.2 / 5.0). */
 DEFINE_FIELD(gas_valve_position, uint8_t, ObisId(0, GAS_MBUS_ID, 24, 4, 0), IntField, units::none);
@@ -320,7 +573,7 @@ DEFINE_FIELD(gas_delivered, TimestampedFixedValue, ObisId(0, GAS_MBUS_ID, 24, 2,
 DEFINE_FIELD(thermal_device_type, uint16_t, ObisId(0, THERMAL_MBUS_ID, 24, 1, 0), IntField, units::none);
 
 /* Equipment identifier (Thermal: heat or cold) */
-DEFINE_FIELD(thermal_equipment_id, String, ObisId(0, THERMAL_MBUS_ID, 96, 1, 0), StringField, 0, 96);
+DEFINE_FIELD(thermal_equipment_id, FieldString, ObisId(0, THERMAL_MBUS_ID, 96, 1, 0), StringField, 0, 96);
 
 /* Valve position (on/off/released) (Note: Removed in 4.0.7 / 4.2.2 / 5.0). */
 DEFINE_FIELD(thermal_valve_position, uint8_t, ObisId(0, THERMAL_MBUS_ID, 24, 4, 0), IntField, units::none);
@@ -334,7 +587,7 @@ DEFINE_FIELD(thermal_delivered, TimestampedFixedValue, ObisId(0, THERMAL_MBUS_ID
 DEFINE_FIELD(water_device_type, uint16_t, ObisId(0, WATER_MBUS_ID, 24, 1, 0), IntField, units::none);
 
 /* Equipment identifier (Thermal: heat or cold) */
-DEFINE_FIELD(water_equipment_id, String, ObisId(0, WATER_MBUS_ID, 96, 1, 0), StringField, 0, 96);
+DEFINE_FIELD(water_equipment_id, FieldString, ObisId(0, WATER_MBUS_ID, 96, 1, 0), StringField, 0, 96);
 
 /* Valve position (on/off/released) (Note: Removed in 4.0.7 / 4.2.2 / 5.0). */
 DEFINE_FIELD(water_valve_position, uint8_t, ObisId(0, WATER_MBUS_ID, 24, 4, 0), IntField, units::none);
@@ -348,7 +601,7 @@ DEFINE_FIELD(water_delivered, TimestampedFixedValue, ObisId(0, WATER_MBUS_ID, 24
 DEFINE_FIELD(slave_device_type, uint16_t, ObisId(0, SLAVE_MBUS_ID, 24, 1, 0), IntField, units::none);
 
 /* Equipment identifier (Thermal: heat or cold) */
-DEFINE_FIELD(slave_equipment_id, String, ObisId(0, SLAVE_MBUS_ID, 96, 1, 0), StringField, 0, 96);
+DEFINE_FIELD(slave_equipment_id, FieldString, ObisId(0, SLAVE_MBUS_ID, 96, 1, 0), StringField, 0, 96);
 
 /* Valve position (on/off/released) (Note: Removed in 4.0.7 / 4.2.2 / 5.0). */
 DEFINE_FIELD(slave_valve_position, uint8_t, ObisId(0, SLAVE_MBUS_ID, 24, 4, 0), IntField, units::none);
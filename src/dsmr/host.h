@@ -0,0 +1,109 @@
+/**
+ * Arduino DSMR parser.
+ *
+ * This software is licensed under the MIT License.
+ *
+ * Copyright (c) 2015 Matthijs Kooijman <matthijs@stdin.nl>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Minimal stand-ins for the parts of the Arduino API used by this
+ * library, so the parser and reader can be compiled and used on a
+ * normal (e.g. Linux) host. This is only included when ARDUINO is not
+ * defined.
+ */
+
+#ifndef DSMR_INCLUDE_HOST_H
+#define DSMR_INCLUDE_HOST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// There is no separate flash address space on the host, so PROGMEM
+// strings are just normal strings and F() only changes the type, so
+// error messages can be passed around the same way as on Arduino.
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+/**
+ * Byte stream to read P1 data from. This has the same interface as the
+ * subset of the Arduino Stream class that is used by P1Reader, so
+ * P1Reader can be fed from a file descriptor, a socket or a test buffer
+ * by subclassing this.
+ */
+class Stream {
+  public:
+    virtual ~Stream() { }
+
+    /**
+     * Returns the number of bytes that can be read without blocking.
+     */
+    virtual int available() = 0;
+
+    /**
+     * Returns the next byte, or -1 when no byte is available.
+     */
+    virtual int read() = 0;
+
+    /**
+     * Returns the next byte without consuming it, or -1 when no byte
+     * is available.
+     */
+    virtual int peek() = 0;
+
+    /**
+     * Reads up to length bytes into buffer. Unlike on Arduino, this
+     * does not wait for more data to arrive, it returns as soon as no
+     * more bytes are available.
+     */
+    virtual size_t readBytes(char *buffer, size_t length) {
+      size_t count = 0;
+      while (count < length) {
+        int c = read();
+        if (c < 0)
+          break;
+        buffer[count++] = (char)c;
+      }
+      return count;
+    }
+};
+
+// There are no pins to toggle on the host, so these do nothing.
+// Subclass or wrap P1Reader if the request pin needs to be controlled
+// through some other means.
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+inline void pinMode(uint8_t /* pin */, uint8_t /* mode */) { }
+inline void digitalWrite(uint8_t /* pin */, uint8_t /* val */) { }
+
+#endif // DSMR_INCLUDE_HOST_H
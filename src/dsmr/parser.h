@@ -31,7 +31,8 @@
 #ifndef DSMR_INCLUDE_PARSER_H
 #define DSMR_INCLUDE_PARSER_H
 
-#include "crc16.h"
+#include "crc.h"
+#include "scan.h"
 #include "util.h"
 
 namespace dsmr {
@@ -64,121 +65,453 @@ template<typename... Ts>
 struct ParsedData;
 
 /**
- * Base case: No fields present.
+ * Helpers to sort a list of fields by their OBIS id at compiletime.
+ * This is used to generate a binary search over the fields, instead of
+ * comparing a line's id with every field in turn.
  */
-template<>
-struct ParsedData<> {
-  ParseResult<void> __attribute__((__always_inline__)) parse_line_inlined(const ObisId& /* id */, const char *str, const char * /* end */) {
+template<typename... Ts>
+struct ObisRank {
+  // Number of fields with an id smaller than the given id
+  static constexpr size_t count_less(const ObisId& /* id */) { return 0; }
+  // Number of fields with the given id
+  static constexpr size_t count_equal(const ObisId& /* id */) { return 0; }
+};
+
+template<typename T, typename... Ts>
+struct ObisRank<T, Ts...> {
+  static constexpr size_t count_less(const ObisId& id) {
+    return (T::id < id ? 1 : 0) + ObisRank<Ts...>::count_less(id);
+  }
+  static constexpr size_t count_equal(const ObisId& id) {
+    return (T::id == id ? 1 : 0) + ObisRank<Ts...>::count_equal(id);
+  }
+};
+
+/**
+ * Finds the field in Ts that has the given position when all fields
+ * in the list are sorted by id (::type is the field found).
+ */
+template<size_t R, typename List, typename... Ts>
+struct SortedField;
+
+template<size_t R, typename... All, typename T, typename... Ts>
+struct SortedField<R, TypeList<All...>, T, Ts...>
+  : Conditional<ObisRank<All...>::count_less(T::id) == R,
+                SortedField<R, TypeList<>, T>,
+                SortedField<R, TypeList<All...>, Ts...>>::type { };
+
+template<size_t R, typename T>
+struct SortedField<R, TypeList<>, T> {
+  typedef T type;
+};
+
+/**
+ * Binary search for the field with the given id among the fields with
+ * a sorted position in [Lo, Hi). This generates a tree of inlined
+ * comparisons, so finding a field takes O(log n) comparisons (just
+ * like a switch statement would) and no lookup tables are needed.
+ */
+template<typename Data, size_t Lo, size_t Hi>
+struct ObisDispatch {
+  typedef typename Data::template sorted_field<(Lo + Hi) / 2> F;
+
+  // key is id.key(), which is calculated only once by the caller
+  static ParseResult<void> __attribute__((__always_inline__)) parse_line(Data *data, uint64_t key, const char *str, const char *end) {
+    constexpr uint64_t field_key = F::id.key();
+    if (key < field_key)
+      return ObisDispatch<Data, Lo, (Lo + Hi) / 2>::parse_line(data, key, str, end);
+    if (key == field_key)
+      return data->template parse_field<F>(str, end);
+    return ObisDispatch<Data, (Lo + Hi) / 2 + 1, Hi>::parse_line(data, key, str, end);
+  }
+};
+
+template<typename Data, size_t Lo>
+struct ObisDispatch<Data, Lo, Lo> {
+  static ParseResult<void> __attribute__((__always_inline__)) parse_line(Data * /* data */, uint64_t /* key */, const char *str, const char * /* end */) {
+    // No field matches
+    return ParseResult<void>().until(str);
+  }
+};
+
+/**
+ * Finds the position of field F in the list Ts (::value is the index).
+ */
+template<typename F, typename... Ts>
+struct FieldIndex;
+
+template<typename F, typename... Ts>
+struct FieldIndex<F, F, Ts...> {
+  static constexpr size_t value = 0;
+};
+
+template<typename F, typename T, typename... Ts>
+struct FieldIndex<F, T, Ts...> {
+  static constexpr size_t value = 1 + FieldIndex<F, Ts...>::value;
+};
+
+/**
+ * Checks whether F is one of Ts (::value is true when it is).
+ */
+template<typename F, typename... Ts>
+struct HasField {
+  static constexpr bool value = false;
+};
+
+template<typename F, typename T, typename... Ts>
+struct HasField<F, T, Ts...> {
+  static constexpr bool value = IsSame<F, T>::value || HasField<F, Ts...>::value;
+};
+
+/**
+ * Checks whether any of Ts stores its value as a StringView, which
+ * points into the message instead of holding a copy (::value is true
+ * when one does).
+ */
+template<typename... Ts>
+struct HasViewField {
+  static constexpr bool value = false;
+};
+
+template<typename T, typename... Ts>
+struct HasViewField<T, Ts...> {
+  static constexpr bool value = IsSame<decltype(static_cast<T*>(nullptr)->val()), StringView&>::value || HasViewField<Ts...>::value;
+};
+
+/**
+ * Calls f.apply(field, present) if f supports that, or f.apply(field)
+ * otherwise.
+ */
+template<typename F, typename Field>
+static inline auto apply_field(F& f, Field& field, bool present, int) -> decltype(f.apply(field, present), void()) {
+  f.apply(field, present);
+}
+
+template<typename F, typename Field>
+static inline void apply_field(F& f, Field& field, bool /* present */, long) {
+  f.apply(field);
+}
+
+/**
+ * The fields of a ParsedData object, which are all inherited as base
+ * classes, one level at a time. Base case: No fields.
+ */
+template<typename... Ts>
+struct ParsedFields {
+  template<typename Data>
+  static ParseResult<void> __attribute__((__always_inline__)) parse_line_inlined(Data * /* data */, const ObisId& /* id */, const char *str, const char * /* end */) {
     // Parsing succeeded, but found no matching handler (so return
     // set the next pointer to show nothing was parsed).
     return ParseResult<void>().until(str);
   }
 
-  template<typename F>
-  void __attribute__((__always_inline__)) applyEach_inlined(F&& /* f */) {
+  template<size_t I, typename P, typename F>
+  void __attribute__((__always_inline__)) applyEach_inlined(const P& /* present */, F&& /* f */) {
     // Nothing to do
   }
 
-  bool all_present_inlined() {
-    return true;
+  void __attribute__((__always_inline__)) reset_inlined() {
+    // Nothing to do
   }
 };
 
-// Do not use F() for multiply-used strings (including strings used from
-// multiple template instantiations), that would result in multiple
-// instances of the string in the binary
-static constexpr char DUPLICATE_FIELD[] DSMR_PROGMEM = "Duplicate field";
-
 /**
  * General case: At least one typename is passed.
  */
 template<typename T, typename... Ts>
-struct ParsedData<T, Ts...> : public T, ParsedData<Ts...> {
+struct ParsedFields<T, Ts...> : public T, ParsedFields<Ts...> {
+  static_assert(ObisRank<Ts...>::count_equal(T::id) == 0, "Each field in ParsedData must have a unique OBIS id");
+
+  template<typename Data>
+  static ParseResult<void> __attribute__((__always_inline__)) parse_line_inlined(Data *data, const ObisId& id, const char *str, const char *end) {
+    if (id == T::id)
+      return data->template parse_field<T>(str, end);
+    return ParsedFields<Ts...>::parse_line_inlined(data, id, str, end);
+  }
+
+  template<size_t I, typename P, typename F>
+  void __attribute__((__always_inline__)) applyEach_inlined(const P& present, F&& f) {
+    apply_field(f, *static_cast<T*>(this), present.test(I), 0);
+    ParsedFields<Ts...>::template applyEach_inlined<I + 1>(present, f);
+  }
+
+  void __attribute__((__always_inline__)) reset_inlined() {
+    clear_value(T::val());
+    ParsedFields<Ts...>::reset_inlined();
+  }
+};
+
+template<typename... Ts>
+struct ParsedData : public ParsedFields<Ts...> {
+  typedef TypeList<Ts...> fields;
+
+  /**
+   * The field that is at position R when all fields are sorted by id.
+   */
+  template<size_t R>
+  using sorted_field = typename SortedField<R, TypeList<Ts...>, Ts...>::type;
+
   /**
    * This method is used by the parser to parse a single line. The
-   * OBIS id of the line is passed, and this method recursively finds a
-   * field with a matching id. If any, it calls it's parse method, which
-   * parses the value and stores it in the field.
+   * OBIS id of the line is passed, and this method finds a field with
+   * a matching id using a binary search generated at compiletime. If
+   * any, it calls it's parse method, which parses the value and stores
+   * it in the field.
    */
   ParseResult<void> parse_line(const ObisId& id, const char *str, const char *end) {
-    return parse_line_inlined(id, str, end);
+    return ObisDispatch<ParsedData, 0, sizeof...(Ts)>::parse_line(this, id.key(), str, end);
   }
 
   /**
-   * always_inline version of parse_line. This is a separate method, to
-   * allow recursively inlining all calls, but still have a non-inlined
-   * top-level parse_line method.
+   * Alternative to parse_line that recursively compares the id with
+   * every field in turn. This is always_inline, to allow inlining all
+   * recursive calls into a single method. This is not used by the
+   * parser anymore, but kept for comparison (see
+   * extras/host/bench_dispatch.cpp).
    */
   ParseResult<void> __attribute__((__always_inline__)) parse_line_inlined(const ObisId& id, const char *str, const char *end) {
-    if (id == T::id) {
-      if (T::present())
-        return ParseResult<void>().fail((const __FlashStringHelper*)DUPLICATE_FIELD, str);
-      T::present() = true;
-      return T::parse(str, end);
-    }
-    return ParsedData<Ts...>::parse_line_inlined(id, str, end);
+    return ParsedFields<Ts...>::parse_line_inlined(this, id, str, end);
+  }
+
+  /**
+   * Parses the value for the given field, unless it was already
+   * present. The field is only marked as present when the entire value
+   * is valid.
+   */
+  template<typename F>
+  ParseResult<void> __attribute__((__always_inline__)) parse_field(const char *str, const char *end) {
+    constexpr size_t i = FieldIndex<F, Ts...>::value;
+    if (_present.test(i))
+      return ParseResult<void>().fail(ParseError::DUPLICATE_FIELD, str);
+    ParseResult<void> res = F::parse(str, end);
+    if (!res.err && res.next != end)
+      res.fail(ParseError::TRAILING_CHARACTERS, res.next);
+    if (!res.err)
+      _present.set(i);
+    return res;
+  }
+
+  /**
+   * Sets the value of the given field by copying it from another
+   * field object, and marks it as present.
+   */
+  template<typename F>
+  void copy_field(const F& field) {
+    _present.set(FieldIndex<F, Ts...>::value);
+    static_cast<F&>(*this) = field;
   }
 
+  /**
+   * Calls f.apply(field, present) for each field, in the order they
+   * were passed to ParsedData. For compatibility, f.apply(field) is
+   * called instead when f does not accept the present argument.
+   */
   template<typename F>
   void applyEach(F&& f) {
-    applyEach_inlined(f);
+    ParsedFields<Ts...>::template applyEach_inlined<0>(_present, f);
   }
 
+  /**
+   * Returns true when the given field was present in the parsed
+   * message.
+   */
+  template<typename F>
+  bool present() const {
+    return _present.test(FieldIndex<F, Ts...>::value);
+  }
+
+  /**
+   * Returns true when the given field is one of the fields of this
+   * object.
+   */
   template<typename F>
-  void  __attribute__((__always_inline__)) applyEach_inlined(F&& f) {
-    T::apply(f);
-    return ParsedData<Ts...>::applyEach_inlined(f);
+  static constexpr bool has_field() {
+    return HasField<F, Ts...>::value;
   }
 
   /**
    * Returns true when all defined fields are present.
    */
-  bool all_present() {
-    return all_present_inlined();
+  bool all_present() const {
+    return _present.all();
   }
 
-  bool all_present_inlined() {
-    return T::present() && ParsedData<Ts...>::all_present_inlined();
+  /**
+   * Returns true when at least one field is present.
+   */
+  bool any_present() const {
+    return _present.any();
+  }
+
+  /**
+   * Returns the number of fields present.
+   */
+  size_t present_count() const {
+    return _present.count();
+  }
+
+  /**
+   * Marks all fields as not present and clears their values, so this
+   * object can be used to parse another message. Unlike assigning a
+   * new ParsedData object, this keeps the memory allocated by String
+   * values, so parsing similar messages does not allocate again.
+   */
+  void reset() {
+    _present.reset();
+    ParsedFields<Ts...>::reset_inlined();
+  }
+
+  // One bit for each field, in the order they were passed
+  Bitset<sizeof...(Ts)> _present;
+};
+
+/**
+ * Alternative to ParsedData that does not parse field values while
+ * parsing the message. Instead, it only remembers where the value of
+ * each field is in the message, and parses it the first time it is
+ * accessed through get() or load(). This saves time when only a few
+ * of the fields in a message are actually used.
+ *
+ * Since the values are parsed from the original message later, the
+ * message must stay unchanged until all needed values are loaded
+ * (like with DSMR_STRING_VIEWS, see fields.h). This also means this
+ * cannot be used with the streaming mode of P1Reader (which fails to
+ * compile).
+ *
+ * Errors in a field value are only detected when loading it. In that
+ * case, the field is marked as not present.
+ */
+template<typename... Ts>
+struct LazyParsedData : public ParsedData<Ts...> {
+  ParseResult<void> parse_line(const ObisId& id, const char *str, const char *end) {
+    return ObisDispatch<LazyParsedData, 0, sizeof...(Ts)>::parse_line(this, id.key(), str, end);
+  }
+
+  /**
+   * Remembers the value for the given field, unless it was already
+   * present.
+   */
+  template<typename F>
+  ParseResult<void> __attribute__((__always_inline__)) parse_field(const char *str, const char *end) {
+    constexpr size_t i = FieldIndex<F, Ts...>::value;
+    // Without any value, the error is returned directly
+    if (str == end)
+      return ParsedData<Ts...>::template parse_field<F>(str, end);
+    if (this->_present.test(i))
+      return ParseResult<void>().fail(ParseError::DUPLICATE_FIELD, str);
+    this->_present.set(i);
+    values[i] = StringView(str, end - str);
+    return ParseResult<void>().until(end);
+  }
+
+  /**
+   * Parses the value of the given field, if that did not happen yet.
+   * Returns the error if the value is invalid, in which case the field
+   * is no longer present.
+   */
+  template<typename F>
+  ParseResult<void> load() {
+    constexpr size_t i = FieldIndex<F, Ts...>::value;
+    if (!this->_present.test(i) || _loaded.test(i))
+      return ParseResult<void>();
+
+    _loaded.set(i);
+    const char *end = values[i].data() + values[i].length();
+    ParseResult<void> res = F::parse(values[i].data(), end);
+    if (!res.err && res.next != end)
+      res.fail(ParseError::TRAILING_CHARACTERS, res.next);
+    if (res.err)
+      this->_present.clear(i);
+    return res;
+  }
+
+  /**
+   * Loads all present fields, returning the first error (if any).
+   */
+  ParseResult<void> load_all() {
+    ParseResult<void> res;
+    ParseResult<void> results[] = {ParseResult<void>(), load<Ts>()...};
+    for (size_t i = 0; i < lengthof(results) && !res.err; ++i)
+      res = results[i];
+    return res;
+  }
+
+  /**
+   * Returns a pointer to the value of the given field (loading it when
+   * needed), or NULL when it is not present or invalid.
+   */
+  template<typename F>
+  auto get() -> decltype(&static_cast<F*>(nullptr)->val()) {
+    if (load<F>().err || !this->template present<F>())
+      return NULL;
+    return &F::val();
+  }
+
+  /**
+   * Like ParsedData::applyEach, but loads all fields first.
+   */
+  template<typename F>
+  void applyEach(F&& f) {
+    load_all();
+    ParsedData<Ts...>::applyEach(f);
+  }
+
+  void reset() {
+    ParsedData<Ts...>::reset();
+    _loaded.reset();
   }
+
+  // The value of each present field in the message
+  StringView values[sizeof...(Ts) ? sizeof...(Ts) : 1];
+  // One bit for each field that was loaded already
+  Bitset<sizeof...(Ts)> _loaded;
 };
 
 
 struct StringParser {
-  static ParseResult<String> parse_string(size_t min, size_t max, const char *str, const char *end) {
-    ParseResult<String> res;
+  /**
+   * Parses a string between parenthesis, returning a reference to it
+   * (without copying it).
+   */
+  static ParseResult<StringView> parse_view(size_t min, size_t max, const char *str, const char *end) {
+    ParseResult<StringView> res;
     if (str >= end || *str != '(')
-      return res.fail(F("Missing ("), str);
+      return res.fail(ParseError::MISSING_OPEN, str);
 
     const char *str_start = str + 1; // Skip (
-    const char *str_end = str_start;
-
-    while(str_end < end && *str_end != ')')
-      ++str_end;
+    const char *str_end = (const char *)memchr(str_start, ')', end - str_start);
 
-    if (str_end == end)
-      return res.fail(F("Missing )"), str_end);
+    if (!str_end)
+      return res.fail(ParseError::MISSING_CLOSE, end);
 
     size_t len = str_end - str_start;
     if (len < min || len > max)
-      return res.fail(F("Invalid string length"), str_start);
+      return res.fail(ParseError::INVALID_STRING_LENGTH, str_start);
 
-    concat_hack(res.result, str_start, len);
+    res.result = StringView(str_start, len);
 
     return res.until(str_end + 1); // Skip )
   }
-};
 
-// Do not use F() for multiply-used strings (including strings used from
-// multiple template instantiations), that would result in multiple
-// instances of the string in the binary
-static constexpr char INVALID_NUMBER[] DSMR_PROGMEM = "Invalid number";
-static constexpr char INVALID_UNIT[] DSMR_PROGMEM = "Invalid unit";
+  static ParseResult<String> parse_string(size_t min, size_t max, const char *str, const char *end) {
+    ParseResult<StringView> view = parse_view(min, max, str, end);
+    ParseResult<String> res = view;
+    if (!view.err)
+      concat_hack(res.result, view.result.data(), view.result.length());
+    return res;
+  }
+};
 
 struct NumParser {
   static ParseResult<uint32_t> parse(size_t max_decimals, const char* unit, const char *str, const char *end) {
     ParseResult<uint32_t> res;
     if (str >= end || *str != '(')
-      return res.fail(F("Missing ("), str);
+      return res.fail(ParseError::MISSING_OPEN, str);
+
+#if DSMR_SWAR
+    if (parse_fast(max_decimals, unit, str, end, &res))
+      return res;
+#endif
 
     const char *num_start = str + 1; // Skip (
     const char *num_end = num_start;
@@ -188,7 +521,7 @@ struct NumParser {
     // Parse integer part
     while(num_end < end && !strchr("*.)", *num_end)) {
       if (*num_end < '0' || *num_end > '9')
-        return res.fail((const __FlashStringHelper*)INVALID_NUMBER, num_end);
+        return res.fail(ParseError::INVALID_NUMBER, num_end);
       value *= 10;
       value += *num_end - '0';
       ++num_end;
@@ -201,7 +534,7 @@ struct NumParser {
       while(num_end < end && !strchr("*)", *num_end) && max_decimals) {
         --max_decimals;
         if (*num_end < '0' || *num_end > '9')
-          return res.fail((const __FlashStringHelper*)INVALID_NUMBER, num_end);
+          return res.fail(ParseError::INVALID_NUMBER, num_end);
         value *= 10;
         value += *num_end - '0';
         ++num_end;
@@ -216,23 +549,76 @@ struct NumParser {
     // messages the unit passed.
     if (unit && *unit) {
       if (num_end >= end || *num_end != '*')
-        return res.fail(F("Missing unit"), num_end);
+        return res.fail(ParseError::MISSING_UNIT, num_end);
       const char *unit_start = ++num_end; // skip *
       while(num_end < end && *num_end != ')' && *unit) {
         // Next character in units do not match?
         if (*num_end++ != *unit++)
-          return res.fail((const __FlashStringHelper*)INVALID_UNIT, unit_start);
+          return res.fail(ParseError::INVALID_UNIT, unit_start);
       }
       // At the end of the message unit, but not the passed unit?
       if (*unit)
-        return res.fail((const __FlashStringHelper*)INVALID_UNIT, unit_start);
+        return res.fail(ParseError::INVALID_UNIT, unit_start);
     }
 
     if (num_end >= end || *num_end != ')')
-      return res.fail(F("Extra data"), num_end);
+      return res.fail(ParseError::EXTRA_DATA, num_end);
 
     return res.succeed(value).until(num_end + 1); // Skip )
   }
+
+#if DSMR_SWAR
+  /**
+   * Parses the common case of a number with up to 7 integer digits,
+   * followed by at most max_decimals decimals and the exact unit. The
+   * integer digits are converted together and the unit is checked with
+   * a single compare. Returns false for anything else (including all
+   * errors), after which the regular parser above takes over.
+   */
+  static bool parse_fast(size_t max_decimals, const char* unit, const char *str, const char *end, ParseResult<uint32_t> *res) {
+    static const uint32_t pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000};
+    const char *p = str + 1; // Skip (
+    if (end - p < 8 || max_decimals >= lengthof(pow10))
+      return false;
+
+    // Integer part. Eight digits in a row might be followed by more,
+    // so leave those to the regular parser.
+    uint64_t w = swar::load(p);
+    uint8_t n = swar::digit_count(w);
+    if (n == 8)
+      return false;
+    uint32_t value = n ? swar::parse_digits(w, n) : 0;
+    p += n;
+
+    // Decimal part. There are only a few, so these are done one by one.
+    size_t decimals = 0;
+    if (*p == '.') {
+      if (!max_decimals)
+        return false;
+      ++p;
+      uint8_t digit;
+      while (decimals < max_decimals && p < end && (digit = *p - '0') <= 9) {
+        value = value * 10 + digit;
+        ++decimals;
+        ++p;
+      }
+    }
+    value *= pow10[max_decimals - decimals];
+
+    // Unit and closing )
+    size_t unit_len = unit ? strlen(unit) : 0;
+    if (unit_len) {
+      if ((size_t)(end - p) < unit_len + 2 || *p != '*' || memcmp(p + 1, unit, unit_len))
+        return false;
+      p += unit_len + 1;
+    }
+    if (p >= end || *p != ')')
+      return false;
+
+    res->succeed(value).until(p + 1); // Skip )
+    return true;
+  }
+#endif // DSMR_SWAR
 };
 
 struct ObisIdParser {
@@ -242,30 +628,36 @@ struct ObisIdParser {
     // parts are set to 255.
     ParseResult<ObisId> res;
     ObisId& id = res.result;
-    res.next = str;
+    const char *p = str;
     uint8_t part = 0;
-    while (res.next < end) {
-      char c = *res.next;
-
-      if (c >= '0' && c <= '9') {
-        uint8_t digit = c - '0';
-        if (id.v[part] > 25 || (id.v[part] == 25 && digit > 5))
-          return res.fail(F("Obis ID has number over 255"), res.next);
-        id.v[part] = id.v[part] * 10 + digit;
-      } else if (part == 0 && c == '-') {
-        part++;
-      } else if (part == 1 && c == ':') {
-        part++;
-      } else if (part > 1 && part < 5 && c == '.') {
-        part++;
+
+    // Parse one part at a time. Digits are detected with a single
+    // (unsigned) compare, and the separator for each part is looked up
+    // rather than tested with a chain of conditions.
+    while (true) {
+      uint16_t value = 0;
+      while (p < end) {
+        uint8_t digit = *p - '0';
+        if (digit > 9)
+          break;
+        value = value * 10 + digit;
+        if (value > 255)
+          return res.fail(ParseError::OBIS_ID_OVERFLOW, p);
+        ++p;
+      }
+      id.v[part] = value;
+
+      if (p < end && part < 5 && *p == "-:..."[part]) {
+        ++p;
+        ++part;
       } else {
         break;
       }
-      ++res.next;
     }
 
+    res.next = p;
     if (res.next == str)
-      return res.fail(F("OBIS id Empty"), str);
+      return res.fail(ParseError::OBIS_ID_EMPTY, str);
 
     for (++part; part < 6; ++part)
       id.v[part] = 255;
@@ -274,6 +666,163 @@ struct ObisIdParser {
   }
 };
 
+/**
+ * Compact description of a parse error: the error code, where in the
+ * message it occurred and on which line. Unlike a ParseResult, this
+ * does not point into the message, so it can be kept (or counted)
+ * after the message is gone. Use render() to get a readable text.
+ */
+struct ParseErrorInfo {
+  ParseError code;
+  // Offset of the error from the start of the parsed string (for
+  // P1Reader, the start of raw()), saturates at 65535
+  uint16_t offset;
+  // Id of the data line containing the error, or all zeroes when the
+  // error is not in a data line
+  ObisId id;
+  // Error message, for custom errors (code OTHER)
+  const __FlashStringHelper *err;
+
+  ParseErrorInfo() : code(ParseError::NONE), offset(0), id(), err(NULL) { }
+
+  /**
+   * Describes the error in res, which resulted from parsing the message
+   * from start up to end.
+   */
+  template<typename T>
+  ParseErrorInfo(const ParseResult<T>& res, const char *start, const char *end)
+    : code(res.code), offset(0), id(), err(res.err) {
+    if (!res.ctx || res.ctx < start || res.ctx > end)
+      return;
+    size_t pos = res.ctx - start;
+    offset = pos < 0xffff ? pos : 0xffff;
+
+    // Find the start of the line and parse its id. This fails for lines
+    // without an id (like the identification and checksum lines).
+    const char *line_start = res.ctx;
+    while (line_start > start && line_start[-1] != '\n')
+      --line_start;
+    ParseResult<ObisId> idres = ObisIdParser::parse(line_start, end);
+    if (!idres.err)
+      id = idres.result;
+  }
+
+  /**
+   * Writes the error as text (e.g. "Invalid unit at offset 123 in
+   * 1-0:1.8.1") into the buffer passed, truncating it when it does not
+   * fit. Returns the length of the text written.
+   */
+  size_t render(char *buf, size_t size) const {
+    BufferWriter out(buf, size);
+    const __FlashStringHelper *msg = err ? err : error_message(code);
+    if (msg)
+      out.write(msg);
+    out.write(" at offset ", 11);
+    out.write_number(offset);
+    if (id != ObisId()) {
+      out.write(" in ", 4);
+      out.write_number(id.v[0]);
+      out.write('-');
+      out.write_number(id.v[1]);
+      out.write(':');
+      out.write_number(id.v[2]);
+      out.write('.');
+      out.write_number(id.v[3]);
+      out.write('.');
+      out.write_number(id.v[4]);
+      if (id.v[5] != 255) {
+        out.write('.');
+        out.write_number(id.v[5]);
+      }
+    }
+    return out.len;
+  }
+};
+
+/**
+ * Collects the errors for lines that were skipped while parsing (see
+ * the skipped argument of P1Parser::parse()). The errors are stored in
+ * the array passed to the constructor (or use StaticLineErrors to have
+ * this object contain the array). When there are more errors than fit,
+ * only the first ones are stored, but all of them are counted.
+ *
+ * The offsets in the errors are relative to the start of the data
+ * (just after the leading /, which is also the start of
+ * P1Reader::raw()).
+ */
+class LineErrors {
+  public:
+    LineErrors(ParseErrorInfo *errors, size_t size)
+      : errors(errors), size(size), count_(0) { }
+
+    void add(const ParseErrorInfo& error) {
+      if (this->count_ < this->size)
+        this->errors[this->count_] = error;
+      ++this->count_;
+    }
+
+    /**
+     * Returns the number of lines skipped (which can be more than the
+     * number of errors stored).
+     */
+    size_t count() const {
+      return this->count_;
+    }
+
+    /**
+     * Returns the number of errors stored.
+     */
+    size_t stored() const {
+      return this->count_ < this->size ? this->count_ : this->size;
+    }
+
+    const ParseErrorInfo& operator[](size_t i) const {
+      return this->errors[i];
+    }
+
+    void clear() {
+      this->count_ = 0;
+    }
+
+    /**
+     * Forgets the errors added after the first count lines were
+     * skipped.
+     */
+    void truncate(size_t count) {
+      if (count < this->count_)
+        this->count_ = count;
+    }
+
+    /**
+     * Moves the offsets of the errors stored back by n bytes, when the
+     * message turned out to start later (offsets that were too large
+     * to store are left alone).
+     */
+    void shift(size_t n) {
+      for (size_t i = 0; i < this->stored(); ++i) {
+        if (this->errors[i].offset != 0xffff)
+          this->errors[i].offset = this->errors[i].offset >= n ? this->errors[i].offset - n : 0;
+      }
+    }
+
+  protected:
+    ParseErrorInfo *errors;
+    size_t size;
+    size_t count_;
+};
+
+/**
+ * LineErrors that contains room for N errors.
+ */
+template<size_t N>
+class StaticLineErrors : public LineErrors {
+  public:
+    StaticLineErrors() : LineErrors(storage, N) { }
+
+  protected:
+    ParseErrorInfo storage[N];
+};
+
 struct CrcParser {
   static const size_t CRC_LEN = 4;
 
@@ -284,7 +833,7 @@ struct CrcParser {
     // This should never happen with the code in this library, but
     // check anyway
     if (str + CRC_LEN > end)
-      return res.fail(F("No checksum found"), str);
+      return res.fail(ParseError::NO_CHECKSUM, str);
 
     // A bit of a messy way to parse the checksum, but all
     // integer-parse functions assume nul-termination
@@ -296,41 +845,266 @@ struct CrcParser {
 
     // See if all four bytes formed a valid number
     if (endp != buf + CRC_LEN)
-      return res.fail(F("Incomplete or malformed checksum"), str);
+      return res.fail(ParseError::MALFORMED_CHECKSUM, str);
 
     res.next = str + CRC_LEN;
     return res.succeed(check);
   }
 };
 
+/**
+ * Appends all fields from the given TypeLists to Out, skipping fields
+ * that are already in it (::type is the resulting TypeList).
+ */
+template<typename Out, typename... Lists>
+struct FieldUnion {
+  typedef Out type;
+};
+
+template<typename... Out, typename... Lists>
+struct FieldUnion<TypeList<Out...>, TypeList<>, Lists...>
+  : FieldUnion<TypeList<Out...>, Lists...> { };
+
+template<typename... Out, typename T, typename... Ts, typename... Lists>
+struct FieldUnion<TypeList<Out...>, TypeList<T, Ts...>, Lists...>
+  : FieldUnion<typename Conditional<HasField<T, Out...>::value, TypeList<Out...>, TypeList<Out..., T>>::type,
+               TypeList<Ts...>, Lists...> { };
+
+/**
+ * Properties of a list of fields passed as a TypeList.
+ */
+template<typename List>
+struct FieldList;
+
+template<typename... Ts>
+struct FieldList<TypeList<Ts...>> {
+  static constexpr size_t size = sizeof...(Ts);
+
+  // True when each id occurs only once in the list (i.e. each field
+  // counts only itself)
+  static constexpr bool unique_ids = IsSame<IndexSequence<ObisRank<Ts...>::count_equal(Ts::id)...>,
+                                            IndexSequence<ObisRank<Ts>::count_equal(Ts::id)...>>::value;
+
+  template<size_t R>
+  using sorted_field = typename SortedField<R, TypeList<Ts...>, Ts...>::type;
+};
+
+/**
+ * The targets of a MultiParsedData object, stored one level at a time
+ * like ParsedFields. Base case: No targets.
+ */
+template<typename... Ds>
+struct ParseTargets {
+  template<typename F>
+  ParseResult<void> parse_field(const char *str, const char * /* end */) {
+    // Not reached, only fields of one of the targets are dispatched
+    return ParseResult<void>().until(str);
+  }
+
+  template<typename F>
+  void copy_field(const F& /* field */) {
+    // Nothing to do
+  }
+
+  void reset() {
+    // Nothing to do
+  }
+};
+
+/**
+ * General case: At least one target is passed.
+ */
+template<typename D, typename... Ds>
+struct ParseTargets<D, Ds...> : public ParseTargets<Ds...> {
+  ParseTargets(D *target, Ds *... targets) : ParseTargets<Ds...>(targets...), target(target) { }
+
+  /**
+   * Parses the value for the given field into the first target that
+   * has it, and copies it to any later targets that have it.
+   */
+  template<typename F>
+  ParseResult<void> __attribute__((__always_inline__)) parse_field(const char *str, const char *end) {
+    return parse_field<F>(str, end, Bool<D::template has_field<F>()>());
+  }
+
+  template<typename F>
+  void copy_field(const F& field) {
+    copy_field(field, Bool<D::template has_field<F>()>());
+  }
+
+  void reset() {
+    target->reset();
+    ParseTargets<Ds...>::reset();
+  }
+
+  D *target;
+
+  private:
+    template<typename F>
+    ParseResult<void> __attribute__((__always_inline__)) parse_field(const char *str, const char *end, Bool<true>) {
+      ParseResult<void> res = target->template parse_field<F>(str, end);
+      if (!res.err)
+        ParseTargets<Ds...>::copy_field(static_cast<const F&>(*target));
+      return res;
+    }
+
+    template<typename F>
+    ParseResult<void> __attribute__((__always_inline__)) parse_field(const char *str, const char *end, Bool<false>) {
+      return ParseTargets<Ds...>::template parse_field<F>(str, end);
+    }
+
+    template<typename F>
+    void copy_field(const F& field, Bool<true>) {
+      target->copy_field(field);
+      ParseTargets<Ds...>::copy_field(field);
+    }
+
+    template<typename F>
+    void copy_field(const F& field, Bool<false>) {
+      ParseTargets<Ds...>::copy_field(field);
+    }
+};
+
+/**
+ * Parses a message into multiple ParsedData objects at once, which
+ * can each have a different (possibly overlapping) list of fields. This
+ * can be passed to P1Parser::parse() instead of a single ParsedData
+ * object, e.g.:
+ *
+ *   MultiParsedData<DisplayData, UploadData> data(&display, &upload);
+ *   P1Parser::parse(&data, msg, len);
+ *
+ * The id of each line is looked up only once in the combined list of
+ * fields. Each value is parsed only once, into the first target that
+ * has the field, and then copied into the other targets that have it.
+ * Note that this copies String values, so using StringView values (see
+ * DSMR_STRING_VIEWS) or StaticString values avoids allocations.
+ *
+ * This only stores pointers to the targets, so it is cheap to create
+ * for every message. The targets should be ParsedData objects
+ * (LazyParsedData is not supported).
+ */
+template<typename... Ds>
+struct MultiParsedData : public ParseTargets<Ds...> {
+  // All fields of all targets, without duplicates
+  typedef typename FieldUnion<TypeList<>, typename Ds::fields...>::type fields;
+  static_assert(FieldList<fields>::unique_ids, "Fields with the same OBIS id must have the same type in all targets");
+
+  template<size_t R>
+  using sorted_field = typename FieldList<fields>::template sorted_field<R>;
+
+  MultiParsedData(Ds *... targets) : ParseTargets<Ds...>(targets...) { }
+
+  /**
+   * Parses a single line, like ParsedData::parse_line.
+   */
+  ParseResult<void> parse_line(const ObisId& id, const char *str, const char *end) {
+    return ObisDispatch<MultiParsedData, 0, FieldList<fields>::size>::parse_line(this, id.key(), str, end);
+  }
+};
+
+/**
+ * Base class for visitors passed to P1Parser::parse_events, which
+ * ignores all events. A visitor can inherit this and only define the
+ * methods for the events it is interested in.
+ */
+struct ParseEventHandler {
+  /**
+   * Called for each line that matches a field, after its value was
+   * parsed successfully. F is the field type, value is of type
+   * F::view_type.
+   */
+  template<typename F, typename V>
+  void on_field(const V& /* value */) { }
+
+  /**
+   * Called for each line that does not match any field, with the
+   * unparsed value (everything after the OBIS id).
+   */
+  void on_unknown(const ObisId& /* id */, const StringView& /* value */) { }
+
+  /**
+   * Called when parsing fails, after which no more events follow.
+   */
+  void on_error(const ParseResult<void>& /* res */) { }
+};
+
+/**
+ * Used by P1Parser::parse_events in place of a ParsedData object, to
+ * pass each value to a visitor instead of storing it.
+ */
+template<typename Visitor, typename... Ts>
+struct ParseEvents {
+  template<size_t R>
+  using sorted_field = typename SortedField<R, TypeList<Ts...>, Ts...>::type;
+
+  ParseEvents(Visitor& visitor) : visitor(visitor) { }
+
+  ParseResult<void> parse_line(const ObisId& id, const char *str, const char *end) {
+    matched = false;
+    ParseResult<void> res = ObisDispatch<ParseEvents, 0, sizeof...(Ts)>::parse_line(this, id.key(), str, end);
+    if (!matched)
+      visitor.on_unknown(id, StringView(str, end - str));
+    return res;
+  }
+
+  /**
+   * Parses the value for the given field into a temporary, and passes
+   * that to the visitor when the complete value is valid.
+   */
+  template<typename F>
+  ParseResult<void> __attribute__((__always_inline__)) parse_field(const char *str, const char *end) {
+    constexpr size_t i = FieldIndex<F, Ts...>::value;
+    matched = true;
+    if (present.test(i))
+      return ParseResult<void>().fail(ParseError::DUPLICATE_FIELD, str);
+    present.set(i);
+
+    typename F::view_type value;
+    ParseResult<void> res = F::parse_value(value, str, end);
+    if (!res.err && res.next != end)
+      res.fail(ParseError::TRAILING_CHARACTERS, res.next);
+    if (!res.err)
+      visitor.template on_field<F>(value);
+    return res;
+  }
+
+  Visitor& visitor;
+  // Set when the last line matched a field
+  bool matched;
+  // One bit for each field seen, to detect duplicates
+  Bitset<sizeof...(Ts)> present;
+};
+
 struct P1Parser {
   /**
     * Parse a complete P1 telegram. The string passed should start
     * with '/' and run up to and including the ! and the following
     * four byte checksum. It's ok if the string is longer, the .next
     * pointer in the result will indicate the next unprocessed byte.
+    *
+    * Normally, parsing stops at the first line with an error. When
+    * skipped is passed, lines with an error are skipped instead (their
+    * fields are left not present) and their errors are added to
+    * skipped. This still fails when the checksum is wrong, or the
+    * message itself is malformed.
     */
-  template <typename... Ts>
-  static ParseResult<void> parse(ParsedData<Ts...> *data, const char *str, size_t n, bool unknown_error = false) {
+  template <typename Data>
+  static ParseResult<void> parse(Data *data, const char *str, size_t n, bool unknown_error = false, LineErrors *skipped = NULL) {
     ParseResult<void> res;
     if (!n || str[0] != '/')
-      return res.fail(F("Data should start with /"), str);
+      return res.fail(ParseError::MISSING_START, str);
 
     // Skip /
     const char *data_start = str + 1;
 
     // Look for ! that terminates the data
-    const char *data_end = data_start;
-    uint16_t crc = _crc16_update(0, *str); // Include the / in CRC
-    while (data_end < str + n && *data_end != '!') {
-      crc = _crc16_update(crc, *data_end);
-      ++data_end;
-    }
+    const char *data_end = (const char *)memchr(data_start, '!', str + n - data_start);
+    if (!data_end)
+      return res.fail(ParseError::NO_CHECKSUM, str + n);
 
-    if (data_end >= str + n)
-      return res.fail(F("No checksum found"), data_end);
-
-    crc = _crc16_update(crc, *data_end); // Include the ! in CRC
+    // Include both the / and the ! in the CRC
+    uint16_t crc = crc16_update(0, str, data_end + 1 - str);
 
     ParseResult<uint16_t> check_res = CrcParser::parse(data_end + 1, str + n);
     if (check_res.err)
@@ -338,69 +1112,221 @@ struct P1Parser {
 
     // Check CRC
     if (check_res.result != crc)
-      return res.fail(F("Checksum mismatch"), data_end + 1);
+      return res.fail(ParseError::CHECKSUM_MISMATCH, data_end + 1);
 
-    res = parse_data(data, data_start, data_end, unknown_error);
+    res = parse_data(data, data_start, data_end, unknown_error, skipped);
     res.next = check_res.next;
     return res;
   }
 
   /**
-   * Parse the data part of a message. Str should point to the first
-   * character after the leading /, end should point to the ! before the
-   * checksum. Does not verify the checksum.
+   * Parse a complete P1 telegram like parse(), storing the result into
+   * all of the given ParsedData objects (see MultiParsedData).
+   */
+  template <typename... Ds>
+  static ParseResult<void> parse_multi(const char *str, size_t n, Ds *... targets) {
+    return parse_multi(str, n, false, NULL, targets...);
+  }
+
+  /**
+   * Like parse_multi() above, with the unknown_error and skipped
+   * arguments of parse() (which come before the targets here, since
+   * those are variadic).
+   */
+  template <typename... Ds>
+  static ParseResult<void> parse_multi(const char *str, size_t n, bool unknown_error, LineErrors *skipped, Ds *... targets) {
+    MultiParsedData<Ds...> data(targets...);
+    return parse(&data, str, n, unknown_error, skipped);
+  }
+
+  /**
+   * Parse a complete P1 telegram like parse(), but instead of storing
+   * values in a ParsedData object, calls methods on the visitor as
+   * each line is parsed:
+   *  - visitor.on_field<F>(value) for each line matching one of the
+   *    fields Ts. For string fields, value is a StringView into str,
+   *    other values are passed as temporaries.
+   *  - visitor.on_unknown(id, value) for each other line, with the
+   *    unparsed value as a StringView into str.
+   *  - visitor.on_error(res) when parsing fails.
+   * The checksum is verified before any line is parsed, so no events
+   * are emitted for corrupted messages (only on_error). The visitor
+   * can inherit ParseEventHandler for default (empty) methods.
+   *
+   * Since nothing is stored, the fields are only used for their id and
+   * parse method and the values can be used without copying them. The
+   * same field types as for ParsedData can be used, e.g.:
+   *
+   *   P1Parser::parse_events<identification, power_delivered>(str, n, visitor);
+   */
+  template <typename... Ts, typename Visitor>
+  static ParseResult<void> parse_events(const char *str, size_t n, Visitor& visitor) {
+    ParseEvents<Visitor, Ts...> events(visitor);
+    ParseResult<void> res = parse(&events, str, n);
+    if (res.err)
+      visitor.on_error(res);
+    return res;
+  }
+
+  /**
+   * Alternative version of parse(), that calculates the checksum
+   * while parsing, rather than in a separate pass over the message
+   * before parsing. For each batch of lines, the checksum is updated
+   * right before parsing them, so the data is only read from memory
+   * once. This returns the same result as parse(), except that the
+   * data object is also modified when the checksum turns out to be
+   * wrong (or missing). In that case, the data object is reset, so
+   * it never contains data from an incorrect message, and the errors
+   * added to skipped (see parse()) are removed again.
    */
-  template <typename... Ts>
-  static ParseResult<void> parse_data(ParsedData<Ts...> *data, const char *str, const char *end, bool unknown_error = false) {
+  template <typename Data>
+  static ParseResult<void> parse_fused(Data *data, const char *str, size_t n, bool unknown_error = false, LineErrors *skipped = NULL) {
     ParseResult<void> res;
-    // Split into lines and parse those
-    const char *line_end = str, *line_start = str;
-
-    // Parse ID line
-    while (line_end < end) {
-      if (*line_end == '\r' || *line_end == '\n') {
-        // The first identification line looks like:
-        // XXX5<id string>
-        // The DSMR spec is vague on details, but in 62056-21, the X's
-        // are a three-letter (registerd) manufacturer ID, the id
-        // string is up to 16 chars of arbitrary characters and the
-        // '5' is a baud rate indication. 5 apparently means 9600,
-        // which DSMR 3.x and below used. It seems that DSMR 2.x
-        // passed '3' here (which is mandatory for "mode D"
-        // communication according to 62956-21), so we also allow
-        // that. Apparently swedish meters use '9' for 115200. This code
-        // used to check the format of the line somewhat, but for
-        // flexibility (and since we do not actually parse the contents
-        // of the line anyway), just allow anything now.
-        //
-        // Offer it for processing using the all-ones Obis ID, which
-        // is not otherwise valid.
-        ParseResult<void> tmp = data->parse_line(ObisId(255, 255, 255, 255, 255, 255), line_start, line_end);
-        if (tmp.err)
-          return tmp;
-        line_start = ++line_end;
+    if (!n || str[0] != '/')
+      return res.fail(ParseError::MISSING_START, str);
+    size_t skipped_before = skipped ? skipped->count() : 0;
+
+    const char *end = str + n;
+    const char *line_start = str + 1; // Skip /
+    const char *data_end = NULL;
+    const char *line_ends[DSMR_SCAN_BATCH];
+    bool id_line = true;
+    // Include the / in the CRC
+    uint16_t crc = crc16_update(0, (uint8_t)'/');
+
+    while (true) {
+      size_t count = find_line_ends(line_start, end, line_ends, lengthof(line_ends));
+
+      // Stop at the first !
+      size_t lines = count;
+      for (size_t i = 0; i < count; ++i) {
+        if (*line_ends[i] == '!') {
+          data_end = line_ends[i];
+          lines = i;
+          break;
+        }
+      }
+
+      // Update the CRC with everything found (including the !)
+      const char *scanned = data_end ? data_end + 1 : count == lengthof(line_ends) ? line_ends[count - 1] + 1 : end;
+      crc = crc16_update(crc, line_start, scanned - line_start);
+
+      for (size_t i = 0; i < lines && !res.err; ++i) {
+        ParseResult<void> tmp = parse_message_line(data, line_start, line_ends[i], &id_line, unknown_error);
+        if (tmp.err) {
+          if (!skipped)
+            res = tmp;
+          else
+            skipped->add(ParseErrorInfo(tmp, str + 1, end));
+        }
+        line_start = line_ends[i] + 1;
+      }
+
+      if (data_end || count < lengthof(line_ends))
+        break;
+
+      if (res.err) {
+        // Stop parsing, but find the end to check the CRC
+        data_end = (const char *)memchr(scanned, '!', end - scanned);
+        if (data_end)
+          crc = crc16_update(crc, scanned, data_end + 1 - scanned);
         break;
       }
-      ++line_end;
+      line_start = scanned;
     }
 
-    // Parse data lines
-    while (line_end < end) {
-      if (*line_end == '\r' || *line_end == '\n') {
-        ParseResult<void> tmp = parse_line(data, line_start, line_end, unknown_error);
-        if (tmp.err)
-          return tmp;
-        line_start = line_end + 1;
+    if (!data_end) {
+      data->reset();
+      if (skipped)
+        skipped->truncate(skipped_before);
+      return ParseResult<void>().fail(ParseError::NO_CHECKSUM, end);
+    }
+
+    ParseResult<uint16_t> check_res = CrcParser::parse(data_end + 1, end);
+    if (check_res.err || check_res.result != crc) {
+      data->reset();
+      if (skipped)
+        skipped->truncate(skipped_before);
+      if (check_res.err)
+        return check_res;
+      return ParseResult<void>().fail(ParseError::CHECKSUM_MISMATCH, data_end + 1);
+    }
+
+    if (!res.err && line_start != data_end)
+      res.fail(ParseError::LAST_LINE_NOT_TERMINATED, data_end);
+
+    res.next = check_res.next;
+    return res;
+  }
+
+  /**
+   * Parse the data part of a message. Str should point to the first
+   * character after the leading /, end should point to the ! before the
+   * checksum. Does not verify the checksum. See parse() for skipped.
+   */
+  template <typename Data>
+  static ParseResult<void> parse_data(Data *data, const char *str, const char *end, bool unknown_error = false, LineErrors *skipped = NULL) {
+    ParseResult<void> res;
+    // Split into lines and parse those. Line endings are found for a
+    // batch of lines at once, which is a lot faster than checking one
+    // byte at a time (see scan.h).
+    const char *line_start = str;
+    const char *line_ends[DSMR_SCAN_BATCH];
+    bool id_line = true;
+
+    while (true) {
+      size_t n = find_line_ends(line_start, end, line_ends, lengthof(line_ends));
+
+      for (size_t i = 0; i < n; ++i) {
+        ParseResult<void> tmp = parse_message_line(data, line_start, line_ends[i], &id_line, unknown_error);
+        if (tmp.err) {
+          if (!skipped)
+            return tmp;
+          skipped->add(ParseErrorInfo(tmp, str, end));
+        }
+        line_start = line_ends[i] + 1;
       }
-      line_end++;
+
+      // A partial batch means the end was reached
+      if (n < lengthof(line_ends))
+        break;
     }
 
-    if (line_end != line_start)
-      return res.fail(F("Last dataline not CRLF terminated"), line_end);
+    if (line_start != end)
+      return res.fail(ParseError::LAST_LINE_NOT_TERMINATED, end);
 
     return res;
   }
 
+  /**
+   * Parse a line from a message, which is the identification line
+   * when id_line is true (which is then cleared).
+   */
+  template <typename Data>
+  static ParseResult<void> parse_message_line(Data *data, const char *line, const char *end, bool *id_line, bool unknown_error) {
+    if (!*id_line)
+      return parse_line(data, line, end, unknown_error);
+
+    // The first identification line looks like:
+    // XXX5<id string>
+    // The DSMR spec is vague on details, but in 62056-21, the X's
+    // are a three-letter (registerd) manufacturer ID, the id
+    // string is up to 16 chars of arbitrary characters and the
+    // '5' is a baud rate indication. 5 apparently means 9600,
+    // which DSMR 3.x and below used. It seems that DSMR 2.x
+    // passed '3' here (which is mandatory for "mode D"
+    // communication according to 62956-21), so we also allow
+    // that. Apparently swedish meters use '9' for 115200. This code
+    // used to check the format of the line somewhat, but for
+    // flexibility (and since we do not actually parse the contents
+    // of the line anyway), just allow anything now.
+    //
+    // Offer it for processing using the all-ones Obis ID, which
+    // is not otherwise valid.
+    *id_line = false;
+    return data->parse_line(ObisId(255, 255, 255, 255, 255, 255), line, end);
+  }
+
   template <typename Data>
   static ParseResult<void> parse_line(Data *data, const char *line, const char *end, bool unknown_error) {
     ParseResult<void> res;
@@ -419,9 +1345,9 @@ struct P1Parser {
     // this field, that's ok. But if it did move, but not all the way
     // to the end, that's an error.
     if (datares.next != idres.next && datares.next != end)
-      return res.fail(F("Trailing characters on data line"), datares.next);
+      return res.fail(ParseError::TRAILING_CHARACTERS, datares.next);
     else if (datares.next == idres.next && unknown_error)
-      return res.fail(F("Unknown field"), line);
+      return res.fail(ParseError::UNKNOWN_FIELD, line);
 
     return res.until(end);
   }
@@ -32,13 +32,89 @@
 #ifndef DSMR_INCLUDE_READER_H
 #define DSMR_INCLUDE_READER_H
 
-#include <Arduino.h>
-#include "crc16.h"
+#include "util.h"
+#include "crc.h"
+#include "ring.h"
 
 #include "parser.h"
 
+#ifndef DSMR_READER_BUFFER_SIZE
+#ifdef __AVR__
+#define DSMR_READER_BUFFER_SIZE 1024
+#else
+#define DSMR_READER_BUFFER_SIZE 2048
+#endif
+#endif
+
+// Number of bytes read from the stream at once by P1Reader::loop()
+#ifndef DSMR_READER_CHUNK_SIZE
+#ifdef __AVR__
+#define DSMR_READER_CHUNK_SIZE 16
+#else
+#define DSMR_READER_CHUNK_SIZE 128
+#endif
+#endif
+
 namespace dsmr {
 
+/**
+ * A complete message stored in one of the slots of a P1Reader. Taken
+ * from the reader using P1Reader::acquire(), after which the reader
+ * leaves its slot alone until it is passed to P1Reader::release().
+ *
+ * This has no constructor, the reader initializes it (so it can be
+ * declared next to the reader without being overwritten, like the
+ * buffer of StaticP1Reader).
+ */
+class P1Message {
+  public:
+    /**
+     * Returns the message (NUL-terminated), without the leading / and
+     * the checksum.
+     */
+    const char *raw() const {
+      return len ? buffer : "";
+    }
+
+    /**
+     * Returns the length of the data returned by raw().
+     */
+    size_t raw_length() const {
+      return len;
+    }
+
+    /**
+     * Parses the message and stores the result into the ParsedData
+     * object passed, like P1Reader::parse() (but without releasing
+     * the message). StringView values point into the slot, they stay
+     * valid until the message is released.
+     */
+    template<typename Data>
+    bool parse(Data *data, ParseErrorInfo *err = NULL, LineErrors *skipped = NULL) const {
+      const char *str = raw(), *end = str + len;
+      ParseResult<void> res = P1Parser::parse_data(data, str, end, false, skipped);
+      if (res.err && err)
+        *err = ParseErrorInfo(res, str, end);
+      return res.err == NULL;
+    }
+
+  protected:
+    friend class P1Reader;
+
+    enum class State : uint8_t {
+      FREE,
+      READY,
+      ACQUIRED,
+    };
+
+    char *buffer;
+    size_t len;
+    // Order in which messages were completed, to hand out the oldest
+    // first
+    uint16_t seq;
+    State state;
+};
+
 /**
  * Controls the request pin on the P1 port to enable (periodic)
  * transmission of messages and reads those messages.
@@ -55,26 +131,118 @@ namespace dsmr {
  *  - clear() is called
  *  - parse() is called
  *  - loop() is called and the start of a new message is available
+ *    (and no other slot is free, see below)
  *
  * When disable is called, the request pin is disabled again and any
  * partial message is discarded. Any bytes received while disabled are
  * dropped.
+ *
+ * Alternatively, the reader can parse each line as soon as it is
+ * received, see stream_into().
+ *
+ * Messages are stored in a buffer of fixed size, which is passed to the
+ * constructor (or use StaticP1Reader to have the reader contain the
+ * buffer). When a message does not fit, it is discarded and the reader
+ * waits for the next message to start. The number of discarded
+ * messages is counted in stats().
+ *
+ * When a message is broken off (e.g. because its ! was lost), the next
+ * message is received as part of it. To not lose that next message as
+ * well, the reader looks for a / in the data received so far when a
+ * message does not fit or has a wrong checksum, and restarts from the
+ * last / found (see Stats::resyncs).
+ *
+ * The buffer can be split into multiple slots, so the next message can
+ * be received while a complete message is still being handled. A
+ * complete message then stays in its slot, until it is cleared (or
+ * taken using acquire() and passed to release()), and the next
+ * message is received into a free slot. Only when no slot is free, the
+ * oldest complete message is discarded (see Stats::dropped). When
+ * multiple messages are complete, available(), raw(), parse() and
+ * clear() apply to the oldest one.
  */
 class P1Reader {
   public:
+    /**
+     * Counters for exceptional events, to allow monitoring the quality
+     * of the connection. These only ever increment (and wrap around).
+     */
+    struct Stats {
+      // Messages discarded because they did not fit in the buffer
+      uint32_t overflows;
+      // Messages discarded because their checksum was wrong or
+      // malformed
+      uint32_t checksum_errors;
+      // Messages restarted from a / found inside a broken message
+      uint32_t resyncs;
+      // Complete messages discarded because a new message started and
+      // no other slot was free, before they were cleared or acquired
+      uint32_t dropped;
+    };
+
     /**
      * Create a new P1Reader. The stream passed should be the serial
      * port to which the P1 TX pin is connected. The req_pin is the
      * pin connected to the request pin. The pin is configured as an
      * output, the Stream is assumed to be already set up (e.g. baud
-     * rate configured).
+     * rate configured). The stream can be NULL when all data is
+     * passed to feed() instead.
+     *
+     * Messages are stored in the buffer passed, which must stay valid
+     * for as long as the reader is used. One byte is used for a
+     * terminating NUL, so the longest message that can be stored (not
+     * counting the leading / and the checksum) is size - 1 bytes.
      */
-    P1Reader(Stream *stream, uint8_t req_pin)
-      : stream(stream), req_pin(req_pin), once(false), state(State::DISABLED_STATE) {
+    P1Reader(Stream *stream, uint8_t req_pin, char *buffer, size_t size)
+      : P1Reader(stream, req_pin, buffer, size, &single_slot, 1) { }
+
+    /**
+     * Create a new P1Reader that splits the buffer passed into count
+     * slots of size / count bytes each, using the slots array passed
+     * (which must have count elements) to keep track of them. The
+     * longest message that can be stored is size / count - 1 bytes.
+     */
+    P1Reader(Stream *stream, uint8_t req_pin, char *buffer, size_t size, P1Message *slots, uint8_t count)
+      : stream(stream), req_pin(req_pin), _available(false), once(false), state(State::DISABLED_STATE),
+        buffer(buffer), buffer_size(size / count), buffer_len(0), allocated(false),
+        slots(slots), slot_count(count), current(slots), ready(0), seq(0), crc_len(0), stats_(),
+        chunk_pos(0), chunk_len(0),
+        stream_data(NULL), stream_parse(NULL), stream_reset(NULL),
+        stream_target(NULL), stream_commit(NULL), stream_err(),
+        stream_skipped(NULL), stream_offset(0), stream_first_line(false), stream_unknown_error(false),
+        stream_id_len(0), stream_id_crc(0) {
       pinMode(req_pin, OUTPUT);
       digitalWrite(req_pin, LOW);
+      for (uint8_t i = 0; i < count; ++i) {
+        slots[i].buffer = buffer + i * this->buffer_size;
+        slots[i].len = 0;
+        slots[i].seq = 0;
+        slots[i].state = P1Message::State::FREE;
+      }
+      this->clear_buffer();
+    }
+
+    /**
+     * Create a new P1Reader that allocates a buffer of
+     * DSMR_READER_BUFFER_SIZE bytes from the heap (once).
+     */
+    P1Reader(Stream *stream, uint8_t req_pin)
+      : P1Reader(stream, req_pin, (char*)malloc(DSMR_READER_BUFFER_SIZE), DSMR_READER_BUFFER_SIZE) {
+      this->allocated = true;
+      // If allocation failed, every message is discarded as too long
+      if (!this->buffer)
+        this->buffer_size = 0;
+    }
+
+    ~P1Reader() {
+      if (this->allocated)
+        free(this->single_slot.buffer);
     }
 
+    // Copying would share the buffer
+    P1Reader(const P1Reader&) = delete;
+    P1Reader& operator=(const P1Reader&) = delete;
+
     /**
      * Enable the request pin, to request data on the P1 port.
      * @param  once    When true, the request pin is automatically
@@ -97,10 +265,110 @@ class P1Reader {
     void disable() {
       digitalWrite(this->req_pin, LOW);
       this->state = State::DISABLED_STATE;
-      if (!this->_available)
-        this->buffer = "";
+      if (!this->_available && this->current->state == P1Message::State::FREE) {
+        this->clear_buffer();
+        if (this->stream_data)
+          this->stream_reset(this->stream_data);
+      }
       // Clear any pending bytes
-      while(this->stream->read() >= 0) /* nothing */;
+      this->chunk_pos = this->chunk_len = 0;
+      if (this->stream)
+        while(this->stream->read() >= 0) /* nothing */;
+    }
+
+    /**
+     * Switch to streaming mode. In this mode, every line is parsed into
+     * the given data object as soon as its line ending is received,
+     * instead of buffering the entire message and parsing it once it
+     * is complete. This means that only a single line is buffered at a
+     * time and that the parsed data is available directly after the
+     * checksum is received.
+     *
+     * Lines are parsed into the data object directly, not into a copy
+     * that is only committed when the checksum matches (which is only
+     * known at the end). So, the data object is reset at the start of
+     * every message, and its contents are only valid while available()
+     * returns true. If the checksum turns out to be incorrect, or a
+     * line could not be parsed, the data object is reset again (so it
+     * never contains data from an incorrect message) and available()
+     * stays false. In the latter case, the error can be retrieved using
+     * stream_error(). To keep the last correct message instead, pass a
+     * pending object as well (see below).
+     *
+     * When skipped is passed, lines that cannot be parsed are skipped
+     * and their errors are added to it, like P1Parser::parse(). It is
+     * cleared along with the data object, so it only contains the
+     * errors for the current message.
+     *
+     * In streaming mode, parse() should not be used, just call clear()
+     * when done with the data. raw() returns only the current line.
+     * Slots are not used in this mode (acquire() returns NULL).
+     *
+     * This should be called before enable(). Pass NULL to switch back
+     * to normal mode.
+     */
+    template<typename... Ts>
+    void stream_into(ParsedData<Ts...> *data, bool unknown_error = false, LineErrors *skipped = NULL) {
+      this->stream_into(data, data, unknown_error, skipped);
+    }
+
+    /**
+     * Like stream_into() above, but parses every line into the pending
+     * object and only copies it into data when the checksum is correct
+     * (and all lines could be parsed). An incorrect message only
+     * resets pending, so data keeps the last correct message until the
+     * next one is complete, also after clear(). This takes twice the
+     * memory and copies every message once (which allocates memory for
+     * String values).
+     */
+    template<typename... Ts>
+    void stream_into(ParsedData<Ts...> *data, ParsedData<Ts...> *pending, bool unknown_error = false, LineErrors *skipped = NULL) {
+      // The buffer only holds the current line, so a StringView would
+      // point to the next line (or garbage) later
+      static_assert(!HasViewField<Ts...>::value, "Fields stored as StringView (e.g. with DSMR_STRING_VIEWS) cannot be used in streaming mode");
+      this->stream_data = pending;
+      this->stream_target = data;
+      this->stream_parse = &parse_streamed_line<ParsedData<Ts...>>;
+      this->stream_reset = &reset_streamed_data<ParsedData<Ts...>>;
+      this->stream_commit = &commit_streamed_data<ParsedData<Ts...>>;
+      this->stream_unknown_error = unknown_error;
+      this->stream_skipped = skipped;
+      this->stream_data_reset();
+      if (data != pending)
+        data->reset();
+    }
+
+    // LazyParsedData only stores views into the message
+    template<typename... Ts, typename... Args>
+    void stream_into(LazyParsedData<Ts...> * /* data */, Args... /* args */) {
+      static_assert(sizeof...(Ts) != sizeof...(Ts), "LazyParsedData cannot be used in streaming mode");
+    }
+
+    void stream_into(decltype(nullptr) /* data */) {
+      this->stream_data = NULL;
+      this->stream_target = NULL;
+      this->stream_skipped = NULL;
+      this->stream_data_reset();
+    }
+
+    /**
+     * In streaming mode, returns true when the last message had a
+     * correct checksum, but could not be parsed. If err is passed, the
+     * error is stored into it, like P1Reader::parse() (with the offset
+     * from the start of the message). Returns false if there was no
+     * such error, or after it is cleared (just like a complete
+     * message).
+     */
+    bool stream_error(ParseErrorInfo *err = NULL) const {
+      // While reading, this is the (not yet reported) error for the
+      // current message
+      if (this->state == State::READING_STATE || this->state == State::CHECKSUM_STATE)
+        return false;
+      if (this->stream_err.code == ParseError::NONE)
+        return false;
+      if (err)
+        *err = this->stream_err;
+      return true;
     }
 
     /**
@@ -108,98 +376,177 @@ class P1Reader {
      * until it is cleared.
      */
     bool available() {
-      return this->_available;
+      return this->_available || this->ready;
     }
 
     /**
      * Check for new data to read. Should be called regularly, such as
      * once every loop. Returns true if a complete message is available
      * (just like available).
+     *
+     * This reads all bytes available from the stream in chunks of up
+     * to DSMR_READER_CHUNK_SIZE bytes (using readBytes()) and passes
+     * them to feed(). Bytes that were read, but not processed yet
+     * because a message was completed, are kept for the next call. So
+     * when this returns without a message being completed, all bytes
+     * available from the stream have been processed.
      */
     bool loop() {
-      while(true) {
-        if (state == State::CHECKSUM_STATE) {
-          // Let the Stream buffer the CRC bytes. Convert to size_t to
-          // prevent unsigned vs signed comparison
-          if ((size_t)this->stream->available() < CrcParser::CRC_LEN)
+      while (true) {
+        if (this->chunk_pos == this->chunk_len) {
+          int available = this->stream->available();
+          if (available <= 0)
             return false;
 
-          char buf[CrcParser::CRC_LEN];
-          for (uint8_t i = 0; i < CrcParser::CRC_LEN; ++i)
-            buf[i] = this->stream->read();
+          size_t len = (size_t)available < sizeof(this->chunk) ? available : sizeof(this->chunk);
+          this->chunk_len = this->stream->readBytes((char*)this->chunk, len);
+          this->chunk_pos = 0;
+          if (!this->chunk_len)
+            return false;
+        }
 
-          ParseResult<uint16_t> crc = CrcParser::parse(buf, buf + lengthof(buf));
+        bool complete;
+        size_t used = this->process(this->chunk + this->chunk_pos, this->chunk_len - this->chunk_pos, &complete);
+        // When disable() was called, the chunk was already emptied
+        if (this->chunk_len)
+          this->chunk_pos += used;
+        if (complete)
+          return this->available();
+      }
+    }
 
-          // Prepare for next message
-          state = State::WAITING_STATE;
+    /**
+     * Like loop(), but processes the bytes waiting in the ring buffer
+     * passed instead of reading them from the stream (which can then
+     * be NULL). This allows receiving bytes from an interrupt handler
+     * or another thread, while loop() is not called for a while. The
+     * bytes are processed directly from the ring buffer, without
+     * copying them to the chunk buffer first.
+     */
+    bool drain(RingBuffer *ring) {
+      while (true) {
+        size_t len;
+        const uint8_t *data = ring->peek(&len);
+        if (!len)
+          return false;
 
-          if (!crc.err && crc.result == this->crc) {
-            // Message complete, checksum correct
-            this->_available = true;
+        bool complete;
+        ring->consume(this->process(data, len, &complete));
+        if (complete)
+          return this->available();
+      }
+    }
 
-            if (once)
-             this->disable();
+    /**
+     * Process a chunk of received bytes, as an alternative to letting
+     * loop() read them from the stream (which can then be NULL). This
+     * is useful when data is received in bulk, e.g. by read() on a
+     * Linux tty or socket.
+     *
+     * Processing stops after the end of a message, so that message can
+     * be handled before the next message starts. The number of bytes
+     * processed is returned, any remaining bytes should be passed to
+     * feed() again after handling the message (i.e. when available()
+     * returns true, or stream_error() returns an error).
+     */
+    size_t feed(const uint8_t *data, size_t len) {
+      bool complete;
+      return this->process(data, len, &complete);
+    }
 
-            return true;
-          }
-        } else {
-          // For other states, read bytes one by one
-          int c = this->stream->read();
-          if (c < 0)
-            return false;
+    /**
+     * Returns the oldest complete message or, when there is none, the
+     * data read so far (NUL-terminated).
+     */
+    const char *raw() {
+      P1Message *msg = this->oldest();
+      if (msg)
+        return msg->raw();
+      return buffer_len ? buffer : "";
+    }
 
-          switch (this->state) {
-            case State::DISABLED_STATE:
-              // Where did this byte come from? Just toss it
-              break;
-            case State::WAITING_STATE:
-              if (c == '/') {
-                this->state = State::READING_STATE;
-                // Include the / in the CRC
-                this->crc = _crc16_update(0, c);
-                this->clear();
-              }
-              break;
-            case State::READING_STATE:
-              // Include the ! in the CRC
-              this->crc = _crc16_update(this->crc, c);
-              if (c == '!')
-                this->state = State::CHECKSUM_STATE;
-              else
-                buffer.concat((char)c);
+    /**
+     * Returns the length of the data returned by raw().
+     */
+    size_t raw_length() {
+      P1Message *msg = this->oldest();
+      return msg ? msg->len : buffer_len;
+    }
 
-              break;
-            case State::CHECKSUM_STATE:
-              // This cannot happen (given the surrounding if), but the
-              // compiler is not smart enough to see this, so list this
-              // case to prevent a warning.
-              abort();
-              break;
-          }
-        }
+    /**
+     * Takes the oldest complete message from the reader, so it can be
+     * handled while the reader continues receiving into another slot.
+     * The message stays valid until it is passed to release(). Returns
+     * NULL when no message is available.
+     */
+    P1Message *acquire() {
+      P1Message *msg = this->oldest();
+      if (msg) {
+        msg->state = P1Message::State::ACQUIRED;
+        this->ready--;
       }
-      return false;
+      return msg;
+    }
+
+    /**
+     * Returns a message taken using acquire() to the reader, so its
+     * slot can be used for a new message.
+     */
+    void release(P1Message *msg) {
+      if (!msg)
+        return;
+      msg->state = P1Message::State::FREE;
+      if (msg == this->current)
+        this->clear_buffer();
     }
 
     /**
-     * Returns the data read so far.
+     * Returns the event counters.
      */
-    const String &raw() {
-      return buffer;
+    const Stats &stats() {
+      return stats_;
     }
 
     /**
      * If a complete message has been received, parse it and store the
      * result into the ParsedData object passed.
      *
-     * After parsing, the message is cleared.
+     * After parsing, the message is cleared. StringView values (see
+     * DSMR_STRING_VIEWS) point into the buffer, they stay valid until
+     * the next call to loop() or feed() (with multiple slots, until
+     * its slot is reused).
      *
      * If parsing fails, false is returned. If err is passed, the error
-     * message is appended to that string.
+     * is stored into it (without allocating memory, use
+     * ParseErrorInfo::render() to get a readable text).
+     *
+     * When skipped is passed, lines that cannot be parsed are skipped
+     * and their errors are added to it, instead of failing (see
+     * P1Parser::parse()).
      */
-    template<typename... Ts>
-    bool parse(ParsedData<Ts...> *data, String *err) {
-      const char *str = buffer.c_str(), *end = buffer.c_str() + buffer.length();
+    template<typename Data>
+    bool parse(Data *data, ParseErrorInfo *err = NULL, LineErrors *skipped = NULL) {
+      const char *str = raw(), *end = str + raw_length();
+      ParseResult<void> res = P1Parser::parse_data(data, str, end, false, skipped);
+
+      if (res.err && err)
+        *err = ParseErrorInfo(res, str, end);
+
+      // Clear the message
+      this->clear();
+
+      return res.err == NULL;
+    }
+
+    /**
+     * Like parse() above, but when parsing fails, the error message
+     * (including the line that caused it, see
+     * ParseResult::fullError()) is stored into the String passed. Note
+     * that this allocates memory for every error.
+     */
+    template<typename Data>
+    bool parse(Data *data, String *err) {
+      const char *str = raw(), *end = str + raw_length();
       ParseResult<void> res = P1Parser::parse_data(data, str, end);
 
       if (res.err && err)
@@ -211,17 +558,508 @@ class P1Reader {
       return res.err == NULL;
     }
 
+    // Without these, parse(data, NULL) would be ambiguous between the
+    // two versions above
+    template<typename Data>
+    bool parse(Data *data, decltype(nullptr) /* err */) {
+      return this->parse(data, (ParseErrorInfo*)NULL);
+    }
+
+    template<typename Data>
+    bool parse(Data *data, decltype(NULL) /* err */) {
+      return this->parse(data, (ParseErrorInfo*)NULL);
+    }
+
     /**
-     * Clear any complete message from the buffer.
+     * Clear the (oldest) complete message from the buffer.
      */
     void clear() {
-      if (_available) {
-        buffer = "";
-        _available = false;
-      }
+      this->release(this->acquire());
+      _available = false;
+      if (stream_error())
+        stream_err = ParseErrorInfo();
     }
 
   protected:
+    /**
+     * Processes received bytes, see feed(). Sets complete to true when
+     * processing stopped at the end of a message.
+     */
+    size_t process(const uint8_t *data, size_t len, bool *complete) {
+      const uint8_t *p = data, *end = data + len;
+      *complete = false;
+      while (p < end) {
+        switch (this->state) {
+          case State::DISABLED_STATE:
+            // Where did these bytes come from? Just toss them
+            return len;
+          case State::WAITING_STATE: {
+            const uint8_t *start = (const uint8_t*)memchr(p, '/', end - p);
+            if (!start)
+              return len;
+            // When all slots are acquired, the message is ignored
+            if (!this->start_message())
+              this->stats_.dropped++;
+            p = start + 1;
+            break;
+          }
+          case State::READING_STATE: {
+            const uint8_t *bang = (const uint8_t*)memchr(p, '!', end - p);
+            const uint8_t *data_end = bang ? bang : end;
+            const uint8_t *next = this->stream_data ? this->append_lines(p, data_end) : this->append(p, data_end);
+            if (next != data_end) {
+              // Message (or line, in streaming mode) too long.
+              // Discard it and continue with a message that started
+              // inside it, or wait for the next message to start.
+              this->stats_.overflows++;
+              if (this->resync(this->buffer_len, NULL)) {
+                p = next;
+                break;
+              }
+              this->clear_buffer();
+              if (this->stream_data)
+                this->stream_discard();
+              this->state = State::WAITING_STATE;
+              // The byte that did not fit might be the / of the next
+              // message, so look at it again
+              p = next;
+              break;
+            }
+
+            // Include the data (append_lines() already did that in
+            // streaming mode) and the ! in the CRC
+            if (!this->stream_data)
+              this->crc = crc16_update(this->crc, (const char*)p, data_end - p);
+            if (!bang)
+              return len;
+            this->update_crc("!", 1);
+
+            // Like P1Parser::parse_data, require a line ending after
+            // the last line
+            if (this->stream_data && this->buffer_len && this->stream_err.code == ParseError::NONE) {
+              ParseResult<void> res;
+              res.fail(ParseError::LAST_LINE_NOT_TERMINATED, this->buffer + this->buffer_len);
+              this->stream_err = this->stream_error_info(res);
+            }
+            this->state = State::CHECKSUM_STATE;
+            this->crc_len = 0;
+            p = bang + 1;
+            break;
+          }
+          case State::CHECKSUM_STATE:
+            while (p < end && this->crc_len < CrcParser::CRC_LEN && *p != '/')
+              this->crc_buf[this->crc_len++] = *p++;
+            if (p < end && this->crc_len < CrcParser::CRC_LEN) {
+              // A new message started before the checksum was complete
+              this->stats_.checksum_errors++;
+              this->stats_.resyncs++;
+              this->discard_message();
+              break;
+            }
+            if (this->crc_len < CrcParser::CRC_LEN)
+              return len;
+
+            if (this->end_message()) {
+              *complete = true;
+              return p - data;
+            }
+            break;
+        }
+      }
+      return len;
+    }
+
+    /**
+     * Called when the / that starts a message is received. Returns
+     * false when there is no slot to receive the message into.
+     */
+    bool start_message() {
+      if (!this->select_slot())
+        return false;
+      this->state = State::READING_STATE;
+      // Include the / in the CRC
+      this->crc = crc16_update(0, (uint8_t)'/');
+      // Clear any partial message left behind by a checksum failure
+      this->clear_buffer();
+      this->_available = false;
+      if (this->stream_data) {
+        this->stream_discard();
+        this->stream_first_line = true;
+      }
+      return true;
+    }
+
+    /**
+     * Makes current point to a slot that a new message can be received
+     * into: The current slot when it is still free, or any other free
+     * slot. When there is none, the oldest complete message is dropped.
+     * Returns false when all slots are acquired.
+     */
+    bool select_slot() {
+      P1Message *slot = this->current;
+      for (uint8_t i = 0; slot->state != P1Message::State::FREE && i < this->slot_count; ++i)
+        slot = &this->slots[i];
+      if (slot->state != P1Message::State::FREE) {
+        slot = this->oldest();
+        if (!slot)
+          return false;
+        slot->state = P1Message::State::FREE;
+        this->ready--;
+        this->stats_.dropped++;
+      }
+      this->current = slot;
+      this->buffer = slot->buffer;
+      return true;
+    }
+
+    /**
+     * Returns the oldest complete message that was not acquired, or
+     * NULL when there is none.
+     */
+    P1Message *oldest() {
+      P1Message *found = NULL;
+      for (uint8_t i = 0; this->ready && i < this->slot_count; ++i) {
+        P1Message *slot = &this->slots[i];
+        if (slot->state == P1Message::State::READY && (!found || (int16_t)(slot->seq - found->seq) < 0))
+          found = slot;
+      }
+      return found;
+    }
+
+    /**
+     * Called when the checksum is received. Returns true when the
+     * message should be handled by the caller (it is available, or has
+     * a stream_error()).
+     */
+    bool end_message() {
+      ParseResult<uint16_t> crc = CrcParser::parse(this->crc_buf, this->crc_buf + lengthof(this->crc_buf));
+
+      // Prepare for next message
+      this->state = State::WAITING_STATE;
+
+      if (crc.err || crc.result != this->crc) {
+        this->stats_.checksum_errors++;
+        // When a message was broken off, the message that follows it
+        // might be complete (in streaming mode, the lines before the
+        // current one are already gone, so only a / in the first line
+        // can be restarted from)
+        bool restarted = !crc.err && (this->stream_data ? this->restart_id_line(crc.result) : this->resync(this->buffer_len, &crc.result));
+        if (!restarted) {
+          this->discard_message();
+          return false;
+        }
+      }
+
+      if (this->stream_id_len)
+        this->parse_id_line(false);
+
+      if (!this->stream_data) {
+        // Message complete, checksum correct: keep it in its slot
+        this->current->len = this->buffer_len;
+        this->current->seq = this->seq++;
+        this->current->state = P1Message::State::READY;
+        this->ready++;
+
+        if (once)
+          this->disable();
+
+        return true;
+      }
+
+      if (this->stream_err.code == ParseError::NONE) {
+        // Message complete, checksum correct
+        if (this->stream_target != this->stream_data)
+          this->stream_commit(this->stream_target, this->stream_data);
+        this->_available = true;
+
+        if (once)
+          this->disable();
+
+        return true;
+      }
+
+      // Do not leave data from an incorrect message behind, but let
+      // the caller see stream_error()
+      this->stream_reset(this->stream_data);
+      return true;
+    }
+
+    /**
+     * Discards the message being received (after an error).
+     */
+    void discard_message() {
+      this->state = State::WAITING_STATE;
+      if (this->stream_data)
+        this->stream_discard();
+    }
+
+    /**
+     * Looks for a / in the first len bytes of the buffer and, when
+     * found, restarts the message from there by moving everything after
+     * it to the start of the buffer. When crc is passed, the message is
+     * complete (the ! was received) and it is only restarted when the
+     * restarted message matches the checksum. Returns true when the
+     * message was restarted.
+     */
+    bool resync(size_t len, const uint16_t *crc) {
+      // The last / is the most likely to start a complete message
+      size_t pos = len;
+      while (pos > 0 && this->buffer[pos - 1] != '/')
+        --pos;
+      if (pos == 0)
+        return false;
+
+      const char *tail = this->buffer + pos;
+      size_t tail_len = this->buffer_len - pos;
+      uint16_t tail_crc = crc16_update(crc16_update(0, (uint8_t)'/'), tail, tail_len);
+      if (crc && crc16_update(tail_crc, (uint8_t)'!') != *crc)
+        return false;
+
+      memmove(this->buffer, tail, tail_len);
+      this->buffer_len = tail_len;
+      if (this->buffer_size)
+        this->buffer[tail_len] = '\0';
+      this->crc = tail_crc;
+      this->stats_.resyncs++;
+      if (this->stream_data) {
+        // The buffer only contains the (partial) first line of the new
+        // message
+        this->stream_discard();
+        this->stream_first_line = true;
+      }
+      return true;
+    }
+
+    /**
+     * Appends the bytes from p up to end to the buffer. Returns a
+     * pointer to the first byte that did not fit (or end when all
+     * bytes fit).
+     */
+    const uint8_t *append(const uint8_t *p, const uint8_t *end) {
+      size_t room = this->buffer_size ? this->buffer_size - 1 - this->buffer_len - this->stream_id_len : 0;
+      size_t len = (size_t)(end - p) < room ? end - p : room;
+      if (len) {
+        memcpy(this->buffer + this->buffer_len, p, len);
+        this->buffer_len += len;
+        this->buffer[this->buffer_len] = '\0';
+      }
+      return p + len;
+    }
+
+    /**
+     * Like append(), but in streaming mode: parses each line as soon
+     * as its line ending is found. Also updates the CRC with all bytes
+     * appended.
+     */
+    const uint8_t *append_lines(const uint8_t *p, const uint8_t *end) {
+      while (true) {
+        const char *found;
+        const uint8_t *eol = end;
+        if (find_line_ends((const char*)p, (const char*)end, &found, 1))
+          eol = (const uint8_t*)found;
+
+        const uint8_t *next = this->append(p, eol);
+        if (next != eol && this->stream_id_len) {
+          // Make room by parsing the identification line now (so the
+          // message can no longer be restarted from it)
+          this->parse_id_line(false);
+          next = this->append(next, eol);
+        }
+        if (next != eol)
+          return next;
+        if (eol == end) {
+          this->update_crc((const char*)p, end - p);
+          return next;
+        }
+
+        // A / can never occur before the value of a data line, or
+        // after its last ) (which ends every data line), so that must
+        // be the start of a new message. After restarting, the CRC
+        // already includes the line up to its line ending.
+        bool restarted = false;
+        if (!this->stream_first_line) {
+          size_t len = this->buffer_len;
+          if (len && this->buffer[len - 1] == ')') {
+            const char *value = (const char*)memchr(this->buffer, '(', len);
+            len = value ? value - this->buffer : len;
+          }
+          restarted = this->resync(len, NULL);
+        }
+        if (!restarted)
+          this->update_crc((const char*)p, eol - p);
+
+        this->stream_line();
+        this->update_crc((const char*)eol, 1);
+        p = eol + 1;
+      }
+    }
+
+    /**
+     * Updates the CRC with bytes of the message, along with the CRC
+     * of the message restarted from the first line kept by
+     * keep_id_line().
+     */
+    void update_crc(const char *p, size_t len) {
+      this->crc = crc16_update(this->crc, p, len);
+      if (this->stream_id_len)
+        this->stream_id_crc = crc16_update(this->stream_id_crc, p, len);
+    }
+
+    void clear_buffer() {
+      // The buffer contents are left alone, so StringView fields
+      // parsed from it stay valid until the next message is received
+      this->buffer_len = 0;
+    }
+
+    /**
+     * Parses the line currently in the buffer (without its line
+     * ending) into the streaming data object, and clears the buffer.
+     * After the first error, further lines are ignored.
+     */
+    void stream_line() {
+      if (this->stream_first_line && this->keep_id_line()) {
+        // Parsed once the checksum is known
+      } else if (this->stream_err.code == ParseError::NONE) {
+        const char *str = buffer, *end = buffer + buffer_len;
+        ParseResult<void> res = this->stream_parse(this->stream_data, str, end, this->stream_first_line, this->stream_unknown_error);
+        if (res.err && this->stream_skipped)
+          this->stream_skipped->add(this->stream_error_info(res));
+        else if (res.err)
+          this->stream_err = this->stream_error_info(res);
+      }
+      this->stream_first_line = false;
+      this->stream_offset += this->buffer_len + 1;
+      this->clear_buffer();
+    }
+
+    /**
+     * Called for the first line in streaming mode. A / in it might
+     * start a message after a broken-off one, or just be part of the
+     * identification (like in "ISK5/2M550T"), which is only known once
+     * the checksum is received. So such a line is not parsed yet, but
+     * kept at the end of the buffer, along with the CRC of the message
+     * as if it started at the last /. Returns true when the line was
+     * kept.
+     */
+    bool keep_id_line() {
+      size_t pos = this->buffer_len;
+      while (pos > 0 && this->buffer[pos - 1] != '/')
+        --pos;
+      if (pos == 0)
+        return false;
+
+      this->stream_id_crc = crc16_update(crc16_update(0, (uint8_t)'/'), this->buffer + pos, this->buffer_len - pos);
+      this->stream_id_len = this->buffer_len;
+      memmove(this->buffer + this->buffer_size - this->buffer_len, this->buffer, this->buffer_len);
+      return true;
+    }
+
+    /**
+     * Restarts the message from the last / in the first line kept by
+     * keep_id_line(), when the message from there matches the checksum
+     * passed. Returns true when the message was restarted.
+     */
+    bool restart_id_line(uint16_t crc) {
+      if (!this->stream_id_len || this->stream_id_crc != crc)
+        return false;
+
+      // Offsets are from the start of the message, which moved
+      const char *line = this->buffer + this->buffer_size - this->stream_id_len;
+      size_t pos = this->stream_id_len;
+      while (line[pos - 1] != '/')
+        --pos;
+      if (this->stream_err.code != ParseError::NONE && this->stream_err.offset != 0xffff)
+        this->stream_err.offset -= pos;
+      if (this->stream_skipped)
+        this->stream_skipped->shift(pos);
+
+      this->stats_.resyncs++;
+      this->parse_id_line(true);
+      return true;
+    }
+
+    /**
+     * Parses the first line kept by keep_id_line(), or when restart is
+     * set, only the part after its last / (where the message turned
+     * out to start).
+     */
+    void parse_id_line(bool restart) {
+      const char *line = this->buffer + this->buffer_size - this->stream_id_len;
+      const char *end = this->buffer + this->buffer_size;
+      this->stream_id_len = 0;
+      if (restart) {
+        const char *start = end;
+        while (start[-1] != '/')
+          --start;
+        line = start;
+      }
+
+      if (this->stream_err.code != ParseError::NONE)
+        return;
+      ParseResult<void> res = this->stream_parse(this->stream_data, line, end, true, this->stream_unknown_error);
+      if (res.err && this->stream_skipped)
+        this->stream_skipped->add(ParseErrorInfo(res, line, end));
+      else if (res.err)
+        this->stream_err = ParseErrorInfo(res, line, end);
+    }
+
+    /**
+     * Describes the error in res, which resulted from parsing the line
+     * in the buffer. The offset is from the start of the message, like
+     * P1Reader::parse().
+     */
+    ParseErrorInfo stream_error_info(const ParseResult<void>& res) {
+      ParseErrorInfo info(res, this->buffer, this->buffer + this->buffer_len);
+      size_t offset = this->stream_offset + info.offset;
+      info.offset = offset < 0xffff ? offset : 0xffff;
+      return info;
+    }
+
+    /**
+     * Resets the streaming data object (and errors) at the start of a
+     * message, or when the message turned out to be incorrect.
+     */
+    void stream_discard() {
+      this->stream_reset(this->stream_data);
+      this->stream_err = ParseErrorInfo();
+      this->stream_offset = 0;
+      this->stream_id_len = 0;
+      if (this->stream_skipped)
+        this->stream_skipped->clear();
+    }
+
+    /**
+     * Discards any partial message after switching modes.
+     */
+    void stream_data_reset() {
+      if (this->state == State::READING_STATE || this->state == State::CHECKSUM_STATE)
+        this->state = State::WAITING_STATE;
+      this->clear_buffer();
+      this->stream_id_len = 0;
+      this->_available = false;
+      this->stream_err = ParseErrorInfo();
+      if (this->stream_data)
+        this->stream_discard();
+    }
+
+    // These are stored as function pointers in stream_parse,
+    // stream_reset and stream_commit, so the reader itself does not
+    // need to know the type of the data object.
+    template<typename Data>
+    static ParseResult<void> parse_streamed_line(void *data, const char *line, const char *end, bool first, bool unknown_error) {
+      return P1Parser::parse_message_line(static_cast<Data*>(data), line, end, &first, unknown_error);
+    }
+
+    template<typename Data>
+    static void reset_streamed_data(void *data) {
+      static_cast<Data*>(data)->reset();
+    }
+
+    template<typename Data>
+    static void commit_streamed_data(void *target, const void *data) {
+      *static_cast<Data*>(target) = *static_cast<const Data*>(data);
+    }
+
     Stream *stream;
     uint8_t req_pin;
     enum class State : uint8_t {
@@ -233,8 +1071,65 @@ class P1Reader {
     bool _available;
     bool once;
     State state;
-    String buffer;
+    // The slot that a message is received into
+    char *buffer;
+    size_t buffer_size;
+    size_t buffer_len;
+    bool allocated;
+    P1Message *slots;
+    uint8_t slot_count;
+    P1Message *current;
+    // Number of slots with a complete message that was not acquired
+    uint8_t ready;
+    uint16_t seq;
+    // Used when the buffer is not split
+    P1Message single_slot;
     uint16_t crc;
+    char crc_buf[CrcParser::CRC_LEN];
+    uint8_t crc_len;
+    Stats stats_;
+
+    // Bytes read from the stream, but not processed yet
+    uint8_t chunk[DSMR_READER_CHUNK_SIZE];
+    size_t chunk_pos;
+    size_t chunk_len;
+
+    // Streaming mode
+    void *stream_data;
+    ParseResult<void> (*stream_parse)(void *data, const char *line, const char *end, bool first, bool unknown_error);
+    void (*stream_reset)(void *data);
+    // Object that stream_data is copied into when the message is
+    // correct, or stream_data itself
+    void *stream_target;
+    void (*stream_commit)(void *target, const void *data);
+    // Error for the current (or last) message
+    ParseErrorInfo stream_err;
+    LineErrors *stream_skipped;
+    // Offset of the line in the buffer from the start of the message
+    size_t stream_offset;
+    bool stream_first_line;
+    bool stream_unknown_error;
+    // Length of the first line kept at the end of the buffer (see
+    // keep_id_line()) and the CRC of the message as if it started at
+    // the last / in that line
+    size_t stream_id_len;
+    uint16_t stream_id_crc;
+};
+
+/**
+ * P1Reader that contains its own buffer of Slots slots of N bytes each,
+ * so no separate buffer needs to be declared. The longest message that
+ * can be stored is N - 1 bytes.
+ */
+template<size_t N, uint8_t Slots = 1>
+class StaticP1Reader : public P1Reader {
+  public:
+    StaticP1Reader(Stream *stream, uint8_t req_pin)
+      : P1Reader(stream, req_pin, storage, N * Slots, slot_storage, Slots) { }
+
+  protected:
+    char storage[N * Slots];
+    P1Message slot_storage[Slots];
 };
 
 } // namespace dsmr
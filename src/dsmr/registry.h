@@ -0,0 +1,409 @@
+/**
+ * Arduino DSMR parser.
+ *
+ * This software is licensed under the MIT License.
+ *
+ * Copyright (c) 2015 Matthijs Kooijman <matthijs@stdin.nl>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Fields that are defined at runtime
+ */
+
+#ifndef DSMR_INCLUDE_REGISTRY_H
+#define DSMR_INCLUDE_REGISTRY_H
+
+#include "util.h"
+#include "parser.h"
+#include "fields.h"
+
+namespace dsmr {
+
+/**
+ * How the value of a runtime field is parsed and stored.
+ */
+enum class FieldKind : uint8_t {
+  // Number with up to 3 decimals and a unit, stored like FixedValue
+  FIXED,
+  // Integer number with optional unit, stored as uint32_t
+  INT,
+  // Single string value between parenthesis
+  STRING,
+  // Everything after the OBIS id, unparsed
+  RAW,
+};
+
+/**
+ * Definition of a field that is only known at runtime.
+ */
+struct RuntimeField {
+  ObisId id;
+  FieldKind kind;
+  // Unit expected for FIXED and INT values ("" for no unit), must stay
+  // valid for as long as the field is used
+  const char *unit;
+};
+
+/**
+ * List of RuntimeFields, which can be changed at runtime. The fields
+ * are kept sorted by id in the array passed to the constructor (or use
+ * StaticObisRegistry to have the registry contain the array), so
+ * looking up a field is a binary search without any extra memory.
+ */
+class ObisRegistry {
+  public:
+    ObisRegistry(RuntimeField *fields, size_t capacity)
+      : fields(fields), capacity(capacity), count(0) { }
+
+    /**
+     * Adds a field. Returns false when the registry is full, or when
+     * there already is a field with the same id.
+     */
+    bool add(const ObisId& id, FieldKind kind, const char *unit = "") {
+      if (this->count == this->capacity || find(id) >= 0)
+        return false;
+
+      // Shift larger ids up to make room, like an insertion sort
+      uint64_t key = id.key();
+      size_t i = this->count;
+      while (i > 0 && this->fields[i - 1].id.key() > key) {
+        this->fields[i] = this->fields[i - 1];
+        --i;
+      }
+      this->fields[i].id = id;
+      this->fields[i].kind = kind;
+      this->fields[i].unit = unit;
+      ++this->count;
+      return true;
+    }
+
+    /**
+     * Removes all fields.
+     */
+    void clear() {
+      this->count = 0;
+    }
+
+    /**
+     * Returns the position of the field with the given id, or -1 when
+     * there is no such field.
+     */
+    int find(const ObisId& id) const {
+      uint64_t key = id.key();
+      size_t lo = 0, hi = this->count;
+      while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        uint64_t mid_key = this->fields[mid].id.key();
+        if (key == mid_key)
+          return mid;
+        if (key < mid_key)
+          hi = mid;
+        else
+          lo = mid + 1;
+      }
+      return -1;
+    }
+
+    const RuntimeField& operator[](size_t i) const {
+      return this->fields[i];
+    }
+
+    size_t size() const {
+      return this->count;
+    }
+
+    /**
+     * Returns the number of fields that fit.
+     */
+    size_t max_size() const {
+      return this->capacity;
+    }
+
+  protected:
+    RuntimeField *fields;
+    size_t capacity;
+    size_t count;
+};
+
+/**
+ * ObisRegistry that contains room for N fields.
+ */
+template<size_t N>
+class StaticObisRegistry : public ObisRegistry {
+  public:
+    StaticObisRegistry() : ObisRegistry(storage, N) { }
+
+  protected:
+    RuntimeField storage[N];
+};
+
+/**
+ * A parsed value of a runtime field, as returned by RuntimeValues.
+ */
+struct RuntimeValue {
+  // The field definition, or NULL when the field was not present
+  const RuntimeField *field;
+  const char *data;
+  size_t len;
+
+  bool present() const {
+    return this->field != NULL;
+  }
+
+  /**
+   * The value of an INT field, or the value in thousands of a FIXED
+   * field.
+   */
+  uint32_t int_val() const {
+    uint32_t v = 0;
+    if (this->len == sizeof(v))
+      memcpy(&v, this->data, sizeof(v));
+    return v;
+  }
+
+  /**
+   * The value of a FIXED field.
+   */
+  FixedValue fixed() const {
+    FixedValue v;
+    v._value = int_val();
+    return v;
+  }
+
+  /**
+   * The value of a STRING or RAW field, which points into the arena
+   * of the RuntimeValues object.
+   */
+  StringView string() const {
+    return StringView(this->data, this->len);
+  }
+};
+
+/**
+ * Parses and stores the values of the fields in an ObisRegistry. This
+ * can be passed to P1Parser::parse() instead of a ParsedData object,
+ * or combined with one using WithRuntimeFields.
+ *
+ * Values are appended to the arena passed to the constructor (or use
+ * StaticRuntimeValues to have the object contain the arena), so no
+ * memory is allocated while parsing. The start of the arena holds one
+ * bit for every field the registry can contain, to find duplicates.
+ * Each value takes eight bytes of header, plus four bytes for numbers
+ * or the length of strings. When a value does not fit, parsing fails.
+ *
+ * Values are stored with their id, so the registry can be changed
+ * while values are stored (values of fields that were removed are no
+ * longer present), but reset() must be called before parsing a message
+ * after that.
+ */
+class RuntimeValues {
+  public:
+    RuntimeValues(const ObisRegistry *registry, char *arena, size_t size)
+      : registry(registry), present((uint8_t*)arena),
+        present_size((registry->max_size() + 7) / 8 <= size ? (registry->max_size() + 7) / 8 : 0),
+        arena(arena + present_size), arena_size(size - present_size), arena_used(0) {
+      reset();
+    }
+
+    /**
+     * Parses a single line, like ParsedData::parse_line. Lines with an
+     * id that is not in the registry are left unparsed.
+     */
+    ParseResult<void> parse_line(const ObisId& id, const char *str, const char *end) {
+      ParseResult<void> res;
+      int field = this->registry->find(id);
+      if (field < 0)
+        return res.until(str);
+
+      // An arena without room for the bits has no room for values
+      if ((size_t)field / 8 >= this->present_size)
+        return res.fail(ParseError::NO_ROOM, str);
+      if ((this->present[field / 8] >> (field % 8)) & 1)
+        return res.fail(ParseError::DUPLICATE_FIELD, str);
+
+      const RuntimeField& f = (*this->registry)[field];
+      uint32_t num;
+      StringView value;
+      switch (f.kind) {
+        case FieldKind::FIXED:
+        case FieldKind::INT: {
+          ParseResult<uint32_t> numres = NumParser::parse(f.kind == FieldKind::FIXED ? 3 : 0, f.unit, str, end);
+          if (numres.err)
+            return numres;
+          num = numres.result;
+          value = StringView((const char*)&num, sizeof(num));
+          res.until(numres.next);
+          break;
+        }
+        case FieldKind::STRING: {
+          ParseResult<StringView> strres = StringParser::parse_view(0, 0xffff, str, end);
+          if (strres.err)
+            return strres;
+          value = strres.result;
+          res.until(strres.next);
+          break;
+        }
+        default:
+          value = StringView(str, end - str);
+          res.until(end);
+          break;
+      }
+
+      if (res.next != end)
+        return res.fail(ParseError::TRAILING_CHARACTERS, res.next);
+      if (!append(id, value))
+        return res.fail(ParseError::NO_ROOM, str);
+      this->present[field / 8] |= 1 << (field % 8);
+      return res;
+    }
+
+    /**
+     * Returns the value of the field with the given id (which is not
+     * present when it was not in the message or is not registered).
+     */
+    RuntimeValue get(const ObisId& id) const {
+      uint64_t key = id.key();
+      for (const char *p = this->arena; p < this->arena + this->arena_used; p += sizeof(Header) + header(p).len) {
+        if (header(p).id.key() == key)
+          return value_at(p);
+      }
+      return RuntimeValue();
+    }
+
+    /**
+     * Calls f.apply(value) for each present value, in the order they
+     * appeared in the message.
+     */
+    template<typename F>
+    void applyEach(F&& f) const {
+      for (const char *p = this->arena; p < this->arena + this->arena_used; p += sizeof(Header) + header(p).len) {
+        RuntimeValue v = value_at(p);
+        if (v.present())
+          f.apply(v);
+      }
+    }
+
+    /**
+     * Returns the number of values present.
+     */
+    size_t present_count() const {
+      size_t n = 0;
+      for (const char *p = this->arena; p < this->arena + this->arena_used; p += sizeof(Header) + header(p).len)
+        n += value_at(p).present();
+      return n;
+    }
+
+    /**
+     * Removes all values, so this object can be used to parse another
+     * message.
+     */
+    void reset() {
+      memset(this->present, 0, this->present_size);
+      this->arena_used = 0;
+    }
+
+  protected:
+    // Stored before each value in the arena
+    struct Header {
+      ObisId id;
+      uint16_t len;
+    };
+
+    static Header header(const char *record) {
+      Header h;
+      memcpy(&h, record, sizeof(h));
+      return h;
+    }
+
+    bool append(const ObisId& id, const StringView& value) {
+      if (value.length() > 0xffff || this->arena_size - this->arena_used < sizeof(Header) + value.length())
+        return false;
+      Header h = {id, (uint16_t)value.length()};
+      memcpy(this->arena + this->arena_used, &h, sizeof(h));
+      memcpy(this->arena + this->arena_used + sizeof(h), value.data(), value.length());
+      this->arena_used += sizeof(h) + value.length();
+      return true;
+    }
+
+    // The field is looked up again, since its position changes when
+    // fields are added
+    RuntimeValue value_at(const char *record) const {
+      Header h = header(record);
+      int field = this->registry->find(h.id);
+      RuntimeValue v = {field < 0 ? NULL : &(*this->registry)[field], record + sizeof(h), h.len};
+      return v;
+    }
+
+    const ObisRegistry *registry;
+    // One bit for each position in the registry, set when it is present
+    uint8_t *present;
+    size_t present_size;
+    char *arena;
+    size_t arena_size;
+    size_t arena_used;
+};
+
+/**
+ * RuntimeValues that contains an arena of N bytes.
+ */
+template<size_t N>
+class StaticRuntimeValues : public RuntimeValues {
+  public:
+    StaticRuntimeValues(const ObisRegistry *registry)
+      : RuntimeValues(registry, storage, N) { }
+
+  protected:
+    char storage[N];
+};
+
+/**
+ * Combines a ParsedData object (or anything else that can be passed to
+ * P1Parser::parse()) with RuntimeValues. Lines are first offered to
+ * the data object, and those that match none of its fields are offered
+ * to the runtime fields, e.g.:
+ *
+ *   WithRuntimeFields<MyData> both(&data, &values);
+ *   P1Parser::parse(&both, msg, len);
+ */
+template<typename Data>
+struct WithRuntimeFields {
+  WithRuntimeFields(Data *data, RuntimeValues *values)
+    : data(data), values(values) { }
+
+  ParseResult<void> parse_line(const ObisId& id, const char *str, const char *end) {
+    ParseResult<void> res = this->data->parse_line(id, str, end);
+    if (res.err || res.next != str)
+      return res;
+    return this->values->parse_line(id, str, end);
+  }
+
+  void reset() {
+    this->data->reset();
+    this->values->reset();
+  }
+
+  Data *data;
+  RuntimeValues *values;
+};
+
+} // namespace dsmr
+
+#endif // DSMR_INCLUDE_REGISTRY_H
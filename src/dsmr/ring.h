@@ -0,0 +1,260 @@
+/**
+ * Arduino DSMR parser.
+ *
+ * This software is licensed under the MIT License.
+ *
+ * Copyright (c) 2015 Matthijs Kooijman <matthijs@stdin.nl>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Ring buffer to pass received bytes from an interrupt handler (or
+ * another thread) to a P1Reader
+ */
+
+#ifndef DSMR_INCLUDE_RING_H
+#define DSMR_INCLUDE_RING_H
+
+#include "util.h"
+
+namespace dsmr {
+
+/**
+ * Ring buffer for bytes, with a single producer (e.g. a UART interrupt
+ * handler, or a thread reading from a tty) and a single consumer (e.g.
+ * P1Reader::drain() called from loop()). Both sides can run at the
+ * same time without locking: The producer only writes the head and
+ * the consumer only writes the tail.
+ *
+ * Bytes are stored in the buffer passed to the constructor (or use
+ * StaticRingBuffer to have the ring buffer contain it). One byte of it
+ * is never used, to tell a full buffer from an empty one. On AVR, only
+ * single byte variables can be accessed atomically, so the buffer can
+ * be at most 256 bytes there.
+ *
+ * When the producer pushes more bytes than fit, those bytes are
+ * dropped. This is counted in overflows(), and high_water() returns
+ * the most bytes that were ever waiting in the buffer, to tell how
+ * close the buffer came to overflowing.
+ */
+class RingBuffer {
+  public:
+#ifdef __AVR__
+    typedef uint8_t index_t;
+    static const size_t MAX_SIZE = 256;
+#else
+    typedef size_t index_t;
+    static const size_t MAX_SIZE = (size_t)-1;
+#endif
+
+    RingBuffer(uint8_t *buffer, size_t size)
+      : buffer(buffer), size(size < MAX_SIZE ? size : (size_t)MAX_SIZE), head(0), tail(0),
+        high(0), overflow_count(0) { }
+
+    // Copying would share the buffer
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    /**
+     * Adds a byte (producer side). Returns false when the buffer is
+     * full and the byte was dropped.
+     */
+    bool push(uint8_t b) {
+      size_t head = this->head, next = advance(head, 1);
+      size_t tail = load(this->tail);
+      if (next == tail) {
+        store(this->overflow_count, (uint32_t)(this->overflow_count + 1));
+        return false;
+      }
+      this->buffer[head] = b;
+      store(this->head, (index_t)next);
+      this->update_high(next, tail);
+      return true;
+    }
+
+    /**
+     * Adds as many bytes as fit (producer side). Returns the number of
+     * bytes added, the rest is dropped.
+     */
+    size_t push(const uint8_t *data, size_t len) {
+      size_t head = this->head, tail = load(this->tail);
+      size_t room = this->size - 1 - used(head, tail);
+      size_t n = len < room ? len : room;
+      // Copy up to the end of the buffer, then wrap around
+      size_t first = n < this->size - head ? n : this->size - head;
+      memcpy(this->buffer + head, data, first);
+      memcpy(this->buffer, data + first, n - first);
+      size_t next = advance(head, n);
+      store(this->head, (index_t)next);
+      this->update_high(next, tail);
+      if (n < len)
+        store(this->overflow_count, (uint32_t)(this->overflow_count + (len - n)));
+      return n;
+    }
+
+    /**
+     * Returns the number of bytes that can be pushed without dropping
+     * any (producer side). Useful for a producer that can wait when
+     * the buffer is full, rather than dropping bytes.
+     */
+    size_t space() const {
+      return this->size - 1 - used(this->head, load(this->tail));
+    }
+
+    /**
+     * Returns the number of bytes waiting in the buffer (consumer
+     * side).
+     */
+    size_t available() const {
+      return used(load(this->head), this->tail);
+    }
+
+    /**
+     * Returns a pointer to the oldest waiting bytes and stores the
+     * number of bytes that can be read from there into len (consumer
+     * side). This is less than available() when the bytes wrap around
+     * the end of the buffer. Pass the number of bytes handled to
+     * consume() afterwards.
+     */
+    const uint8_t *peek(size_t *len) const {
+      size_t head = load(this->head), tail = this->tail;
+      *len = head >= tail ? head - tail : this->size - tail;
+      return this->buffer + tail;
+    }
+
+    /**
+     * Removes len bytes (at most the number returned by peek()) from
+     * the buffer (consumer side).
+     */
+    void consume(size_t len) {
+      store(this->tail, (index_t)advance(this->tail, len));
+    }
+
+    /**
+     * Removes and returns the oldest byte, or returns -1 when the
+     * buffer is empty (consumer side).
+     */
+    int read() {
+      size_t len;
+      const uint8_t *p = peek(&len);
+      if (!len)
+        return -1;
+      uint8_t b = *p;
+      consume(1);
+      return b;
+    }
+
+    /**
+     * Returns the most bytes that were ever waiting in the buffer.
+     */
+    size_t high_water() const {
+      return load(this->high);
+    }
+
+    /**
+     * Returns the number of bytes dropped because the buffer was full.
+     * This only ever increments (and wraps around).
+     */
+    uint32_t overflows() const {
+      return load(this->overflow_count);
+    }
+
+    /**
+     * Returns the number of bytes that fit in the buffer.
+     */
+    size_t capacity() const {
+      return this->size - 1;
+    }
+
+  protected:
+    size_t advance(size_t pos, size_t n) const {
+      pos += n;
+      return pos >= this->size ? pos - this->size : pos;
+    }
+
+    size_t used(size_t head, size_t tail) const {
+      return head >= tail ? head - tail : head + this->size - tail;
+    }
+
+    // Called by the producer only, so no other side writes high
+    void update_high(size_t head, size_t tail) {
+      size_t n = used(head, tail);
+      if (n > this->high)
+        store(this->high, (index_t)n);
+    }
+
+    // Variables written by one side are accessed by the other side
+    // through these, so it sees the bytes in the buffer before the
+    // index that makes them visible (and the compiler does not keep
+    // the variable in a register).
+    template<typename T>
+    static T load(const T& var) {
+#ifdef __AVR__
+      // There is only one core, but the interrupt handler can change
+      // a multi-byte variable (i.e. the overflow counter) halfway
+      // through reading it, so read it until it is stable. The
+      // handler itself cannot be interrupted.
+      const volatile T *p = &var;
+      T val = *p;
+      for (T again = *p; again != val; again = *p)
+        val = again;
+      __asm__ __volatile__ ("" ::: "memory");
+      return val;
+#else
+      return __atomic_load_n(&var, __ATOMIC_ACQUIRE);
+#endif
+    }
+
+    template<typename T>
+    static void store(T& var, T val) {
+#ifdef __AVR__
+      __asm__ __volatile__ ("" ::: "memory");
+      *(volatile T*)&var = val;
+#else
+      __atomic_store_n(&var, val, __ATOMIC_RELEASE);
+#endif
+    }
+
+    uint8_t *buffer;
+    size_t size;
+    index_t head;
+    index_t tail;
+    index_t high;
+    uint32_t overflow_count;
+};
+
+/**
+ * RingBuffer that contains its own buffer of N bytes (so N - 1 bytes
+ * fit).
+ */
+template<size_t N>
+class StaticRingBuffer : public RingBuffer {
+  static_assert(N <= RingBuffer::MAX_SIZE, "Ring buffer too big for this platform");
+
+  public:
+    StaticRingBuffer() : RingBuffer(storage, N) { }
+
+  protected:
+    uint8_t storage[N];
+};
+
+} // namespace dsmr
+
+#endif // DSMR_INCLUDE_RING_H
@@ -0,0 +1,263 @@
+/**
+ * Arduino DSMR parser.
+ *
+ * This software is licensed under the MIT License.
+ *
+ * Copyright (c) 2015 Matthijs Kooijman <matthijs@stdin.nl>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Scanning for line endings. P1Parser splits a message into lines by
+ * first finding the line endings (\r or \n, as well as the ! that
+ * ends the data) for many lines at once,
+ * using one of several implementations that check multiple bytes at
+ * a time. This is selected at compiletime through DSMR_SCAN_BACKEND,
+ * which can be set to one of:
+ *  - DSMR_SCAN_SCALAR: Check one byte at a time. This is the default
+ *    on AVR, which has no wide registers to speed this up.
+ *  - DSMR_SCAN_SWAR: Check a 32-bit or 64-bit word at a time using
+ *    normal integer operations. This is the default on other
+ *    little-endian platforms without SIMD.
+ *  - DSMR_SCAN_SSE2: Check 16 bytes at a time using SSE2, which is
+ *    always available on x86_64. If the CPU supports AVX2 (checked at
+ *    runtime), 32 bytes at a time are checked instead. This is the
+ *    default on x86_64 with gcc or clang.
+ *  - DSMR_SCAN_NEON: Check 16 bytes at a time using NEON. This is the
+ *    default on ARM platforms that have NEON (e.g. 64-bit ARM).
+ */
+
+#ifndef DSMR_INCLUDE_SCAN_H
+#define DSMR_INCLUDE_SCAN_H
+
+#include "util.h"
+
+#define DSMR_SCAN_SCALAR 1
+#define DSMR_SCAN_SWAR 2
+#define DSMR_SCAN_SSE2 3
+#define DSMR_SCAN_NEON 4
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define DSMR_SCAN_HAVE_SWAR
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DSMR_SCAN_HAVE_SSE2
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) && defined(DSMR_SCAN_HAVE_SWAR)
+#define DSMR_SCAN_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+#ifndef DSMR_SCAN_BACKEND
+  #if defined(ARDUINO_ARCH_AVR) || defined(__AVR__)
+    #define DSMR_SCAN_BACKEND DSMR_SCAN_SCALAR
+  #elif defined(DSMR_SCAN_HAVE_SSE2)
+    #define DSMR_SCAN_BACKEND DSMR_SCAN_SSE2
+  #elif defined(DSMR_SCAN_HAVE_NEON)
+    #define DSMR_SCAN_BACKEND DSMR_SCAN_NEON
+  #elif defined(DSMR_SCAN_HAVE_SWAR)
+    #define DSMR_SCAN_BACKEND DSMR_SCAN_SWAR
+  #else
+    #define DSMR_SCAN_BACKEND DSMR_SCAN_SCALAR
+  #endif
+#endif
+
+#if DSMR_SCAN_BACKEND == DSMR_SCAN_SWAR && !defined(DSMR_SCAN_HAVE_SWAR)
+#error "DSMR_SCAN_SWAR needs a little-endian platform"
+#endif
+#if DSMR_SCAN_BACKEND == DSMR_SCAN_SSE2 && !defined(DSMR_SCAN_HAVE_SSE2)
+#error "DSMR_SCAN_SSE2 needs x86_64 and gcc or clang"
+#endif
+#if DSMR_SCAN_BACKEND == DSMR_SCAN_NEON && !defined(DSMR_SCAN_HAVE_NEON)
+#error "DSMR_SCAN_NEON needs a little-endian platform with NEON"
+#endif
+
+// Number of line endings P1Parser looks for at once
+#ifndef DSMR_SCAN_BATCH
+#ifdef __AVR__
+#define DSMR_SCAN_BATCH 8
+#else
+#define DSMR_SCAN_BATCH 32
+#endif
+#endif
+
+namespace dsmr {
+
+namespace scan {
+
+/**
+ * Adds a pointer to ends for every bit set in mask (bit n meaning
+ * p[n * stride] is a line ending), until max pointers are stored.
+ * Returns false when ends is full.
+ */
+template<typename T>
+static inline bool add_ends(T mask, uint8_t stride, const char *p, const char **ends, size_t *n, size_t max) {
+  while (mask) {
+    if (*n == max)
+      return false;
+    ends[(*n)++] = p + __builtin_ctzll(mask) / stride;
+    mask &= mask - 1;
+  }
+  return true;
+}
+
+} // namespace scan
+
+/**
+ * Finds line endings (\r or \n) and ! characters (which end the data
+ * part of a message) in the range [str, end) and stores pointers to
+ * them in ends, stopping when max of them are found.
+ * Returns the number found. When this is less than max, the entire
+ * range was scanned. Otherwise, the next call should start after the
+ * last line ending found.
+ *
+ * This version checks one byte at a time.
+ */
+static inline size_t find_line_ends_scalar(const char *str, const char *end, const char **ends, size_t max) {
+  size_t n = 0;
+  for (const char *p = str; p < end && n < max; ++p) {
+    if (*p == '\r' || *p == '\n' || *p == '!')
+      ends[n++] = p;
+  }
+  return n;
+}
+
+#ifdef DSMR_SCAN_HAVE_SWAR
+/**
+ * Like find_line_ends_scalar(), but checks a word at a time.
+ */
+static inline size_t find_line_ends_swar(const char *str, const char *end, const char **ends, size_t max) {
+  // The largest unsigned integer type that is fast on this platform
+  typedef Conditional<(UINTPTR_MAX > 0xffffffff), uint64_t, uint32_t>::type word;
+  const word ones = (word)-1 / 0xff; // 0x0101...
+  const word low7 = ones * 0x7f;
+  const word cr = ones * '\r', lf = ones * '\n', bang = ones * '!';
+
+  size_t n = 0;
+  const char *p = str;
+  while (end - p >= (ptrdiff_t)sizeof(word)) {
+    word w;
+    memcpy(&w, p, sizeof(w));
+    // Set the top bit of each byte that is zero after the xor (exact,
+    // unlike the usual (x - ones) & ~x & high trick, which can flag
+    // bytes after a real match).
+    word x = w ^ cr, y = w ^ lf, z = w ^ bang;
+    word mask = ~(((x & low7) + low7) | x | low7) |
+                ~(((y & low7) + low7) | y | low7) |
+                ~(((z & low7) + low7) | z | low7);
+    if (!scan::add_ends(mask, 8, p, ends, &n, max))
+      return n;
+    p += sizeof(word);
+  }
+  return n + find_line_ends_scalar(p, end, ends + n, max - n);
+}
+#endif // DSMR_SCAN_HAVE_SWAR
+
+#ifdef DSMR_SCAN_HAVE_SSE2
+namespace scan {
+
+__attribute__((target("avx2"))) static inline size_t line_ends_avx2(const char *str, const char *end, const char **ends, size_t max) {
+  const __m256i cr = _mm256_set1_epi8('\r'), lf = _mm256_set1_epi8('\n'), bang = _mm256_set1_epi8('!');
+  size_t n = 0;
+  const char *p = str;
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i eq = _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf));
+    uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(eq, _mm256_cmpeq_epi8(v, bang)));
+    if (!add_ends(mask, 1, p, ends, &n, max))
+      return n;
+    p += 32;
+  }
+  return n + find_line_ends_scalar(p, end, ends + n, max - n);
+}
+
+} // namespace scan
+
+/**
+ * Like find_line_ends_scalar(), but checks 16 bytes at a time using
+ * SSE2, or 32 bytes at a time using AVX2 if the CPU supports it.
+ */
+static inline size_t find_line_ends_sse2(const char *str, const char *end, const char **ends, size_t max) {
+  if (end - str >= 64 && __builtin_cpu_supports("avx2"))
+    return scan::line_ends_avx2(str, end, ends, max);
+
+  const __m128i cr = _mm_set1_epi8('\r'), lf = _mm_set1_epi8('\n'), bang = _mm_set1_epi8('!');
+  size_t n = 0;
+  const char *p = str;
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i eq = _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf));
+    uint32_t mask = _mm_movemask_epi8(_mm_or_si128(eq, _mm_cmpeq_epi8(v, bang)));
+    if (!scan::add_ends(mask, 1, p, ends, &n, max))
+      return n;
+    p += 16;
+  }
+  return n + find_line_ends_scalar(p, end, ends + n, max - n);
+}
+#endif // DSMR_SCAN_HAVE_SSE2
+
+#ifdef DSMR_SCAN_HAVE_NEON
+/**
+ * Like find_line_ends_scalar(), but checks 16 bytes at a time using
+ * NEON.
+ */
+static inline size_t find_line_ends_neon(const char *str, const char *end, const char **ends, size_t max) {
+  const uint8x16_t cr = vdupq_n_u8('\r'), lf = vdupq_n_u8('\n'), bang = vdupq_n_u8('!');
+  size_t n = 0;
+  const char *p = str;
+  while (end - p >= 16) {
+    uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+    uint8x16_t eq = vorrq_u8(vorrq_u8(vceqq_u8(v, cr), vceqq_u8(v, lf)), vceqq_u8(v, bang));
+    // NEON has no movemask, so narrow each byte to 4 bits instead,
+    // giving a 64-bit mask with 4 bits per byte.
+    uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+    mask &= 0x8888888888888888ULL;
+    if (!scan::add_ends(mask, 4, p, ends, &n, max))
+      return n;
+    p += 16;
+  }
+  return n + find_line_ends_scalar(p, end, ends + n, max - n);
+}
+#endif // DSMR_SCAN_HAVE_NEON
+
+/**
+ * Finds line endings using the selected backend, see
+ * find_line_ends_scalar().
+ */
+static inline size_t find_line_ends(const char *str, const char *end, const char **ends, size_t max) {
+#if DSMR_SCAN_BACKEND == DSMR_SCAN_SCALAR
+  return find_line_ends_scalar(str, end, ends, max);
+#elif DSMR_SCAN_BACKEND == DSMR_SCAN_SWAR
+  return find_line_ends_swar(str, end, ends, max);
+#elif DSMR_SCAN_BACKEND == DSMR_SCAN_SSE2
+  return find_line_ends_sse2(str, end, ends, max);
+#elif DSMR_SCAN_BACKEND == DSMR_SCAN_NEON
+  return find_line_ends_neon(str, end, ends, max);
+#else
+#error "Unknown DSMR_SCAN_BACKEND"
+#endif
+}
+
+} // namespace dsmr
+
+#endif // DSMR_INCLUDE_SCAN_H
@@ -37,16 +37,215 @@
 #define DSMR_PROGMEM PROGMEM
 #endif
 
+#ifdef ARDUINO
 #include <Arduino.h>
+#else
+#include "host.h"
+#endif
+
+// On 64-bit little-endian platforms, some parsers use SWAR (SIMD
+// within a register) tricks to process 8 characters at a time. Define
+// DSMR_SWAR to 0 to disable this.
+#ifndef DSMR_SWAR
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && UINTPTR_MAX > 0xffffffff
+#define DSMR_SWAR 1
+#else
+#define DSMR_SWAR 0
+#endif
+#endif
 
 namespace dsmr {
 
+#ifndef ARDUINO
+// Outside of Arduino, values and error messages are stored in normal
+// C++ strings.
+typedef std::string String;
+#endif
+
 /**
  * Small utility to get the length of an array at compiletime.
  */
 template<typename T, unsigned int sz>
 inline unsigned int lengthof(const T (&)[sz]) { return sz; }
 
+/**
+ * Compiletime list of indices, used to expand arrays and parameter
+ * packs. MakeIndexSequence<N>::type is IndexSequence<0, 1, ..., N-1>.
+ * This is the C++14 std::index_sequence, which is not available in
+ * C++11 (and not at all on AVR, which has no standard library).
+ */
+template<size_t... Is>
+struct IndexSequence { };
+
+template<size_t N, size_t... Is>
+struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, Is...> { };
+
+template<size_t... Is>
+struct MakeIndexSequence<0, Is...> {
+  typedef IndexSequence<Is...> type;
+};
+
+/**
+ * Compiletime list of types.
+ */
+template<typename... Ts>
+struct TypeList { };
+
+/**
+ * Selects A when C is true, B otherwise (like std::conditional).
+ */
+template<bool C, typename A, typename B>
+struct Conditional {
+  typedef A type;
+};
+
+template<typename A, typename B>
+struct Conditional<false, A, B> {
+  typedef B type;
+};
+
+/**
+ * Fixed-size set of N bits, stored in as few (native) words as
+ * possible, so operations on all bits take just a few instructions.
+ */
+template<size_t N>
+struct Bitset {
+  typedef typename Conditional<(sizeof(void*) > 2), uintptr_t, uint8_t>::type word_t;
+  static constexpr size_t WORD_BITS = 8 * sizeof(word_t);
+  static constexpr size_t WORDS = N ? (N + WORD_BITS - 1) / WORD_BITS : 1;
+
+  bool test(size_t i) const { return (words[i / WORD_BITS] >> (i % WORD_BITS)) & 1; }
+  void set(size_t i) { words[i / WORD_BITS] |= (word_t)1 << (i % WORD_BITS); }
+  void clear(size_t i) { words[i / WORD_BITS] &= ~((word_t)1 << (i % WORD_BITS)); }
+  void reset() { memset(words, 0, sizeof(words)); }
+
+  /**
+   * Returns true when all N bits are set.
+   */
+  bool all() const {
+    for (size_t i = 0; i < WORDS; ++i) {
+      if (words[i] != mask(i))
+        return false;
+    }
+    return true;
+  }
+
+  /**
+   * Returns true when any bit is set.
+   */
+  bool any() const {
+    for (size_t i = 0; i < WORDS; ++i) {
+      if (words[i])
+        return true;
+    }
+    return false;
+  }
+
+  /**
+   * Returns the number of bits set.
+   */
+  size_t count() const {
+    size_t n = 0;
+    for (size_t i = 0; i < WORDS; ++i)
+      n += sizeof(word_t) <= sizeof(unsigned) ? __builtin_popcount(words[i]) : __builtin_popcountll(words[i]);
+    return n;
+  }
+
+  word_t words[WORDS] = {};
+
+  private:
+    // The bits in use in word i
+    static constexpr word_t mask(size_t i) {
+      return i < N / WORD_BITS ? (word_t)~(word_t)0 : i > N / WORD_BITS ? 0 : (word_t)(((word_t)1 << (N % WORD_BITS)) - 1);
+    }
+};
+
+/**
+ * Checks whether A and B are the same type (like std::is_same).
+ */
+template<typename A, typename B>
+struct IsSame {
+  static constexpr bool value = false;
+};
+
+template<typename A>
+struct IsSame<A, A> {
+  static constexpr bool value = true;
+};
+
+/**
+ * Compiletime boolean as a type, to select between overloads (like
+ * std::integral_constant<bool, B>).
+ */
+template<bool B>
+struct Bool {
+  static constexpr bool value = B;
+};
+
+#if DSMR_SWAR
+namespace swar {
+
+/**
+ * Loads 8 bytes from str, the first byte in the least significant
+ * position.
+ */
+static inline uint64_t load(const char *str) {
+  uint64_t w;
+  memcpy(&w, str, sizeof(w));
+  return w;
+}
+
+/**
+ * Returns a mask with the top bit set in every byte of w that is not
+ * an ASCII digit.
+ */
+static inline uint64_t non_digits(uint64_t w) {
+  // Digits become 0-9, anything else becomes >= 10
+  uint64_t t = w ^ 0x3030303030303030ULL;
+  // Adding 0x76 sets the top bit for 10 and up. The top bit is cleared
+  // first (and checked separately), so this cannot carry into the next
+  // byte.
+  return (((t & 0x7f7f7f7f7f7f7f7fULL) + 0x7676767676767676ULL) | t) & 0x8080808080808080ULL;
+}
+
+/**
+ * Converts a mask with only the top bit of each byte possibly set (as
+ * returned by non_digits) into an 8-bit mask, with bit n set when byte
+ * n had its top bit set.
+ */
+static inline uint8_t compress_mask(uint64_t mask) {
+  // The multiplication shifts the bit for byte n to bit 56 + n, and
+  // never generates carries.
+  return ((mask >> 7) * 0x0102040810204080ULL) >> 56;
+}
+
+/**
+ * Returns the number of leading (lowest) bytes in w that are ASCII
+ * digits.
+ */
+static inline uint8_t digit_count(uint64_t w) {
+  uint64_t mask = non_digits(w);
+  return mask ? __builtin_ctzll(mask) / 8 : 8;
+}
+
+/**
+ * Converts the first n (1-8) bytes of w, which must all be ASCII
+ * digits, into their decimal value.
+ */
+static inline uint32_t parse_digits(uint64_t w, uint8_t n) {
+  // Move the digits to the top bytes, so the bytes below them count
+  // as leading zeroes.
+  w = (w & 0x0f0f0f0f0f0f0f0fULL) << (8 * (8 - n));
+  // Combine pairs of digits, then pairs of pairs, then the two halves
+  w = ((w * (1 + (10 << 8))) >> 8) & 0x00ff00ff00ff00ffULL;
+  w = ((w * (1 + (100 << 16))) >> 16) & 0x0000ffff0000ffffULL;
+  return (w * (1 + (10000ULL << 32))) >> 32;
+}
+
+} // namespace swar
+#endif // DSMR_SWAR
+
+#ifdef ARDUINO
 // Hack until https://github.com/arduino/Arduino/pull/1936 is merged.
 // This appends the given number of bytes from the given C string to the
 // given Arduino string, without requiring a trailing NUL.
@@ -59,6 +258,282 @@ static void concat_hack(String& s, const char *append, size_t n) {
   s.concat(buf);
 }
 
+// Appends an error message (which lives in flash) to the given string.
+static inline void concat_flash(String& s, const __FlashStringHelper *str) {
+  s += str;
+}
+#else
+// std::string can append a counted range directly, no need to copy
+// and terminate it first.
+static inline void concat_hack(String& s, const char *append, size_t n) {
+  s.append(std::string_view(append, n));
+}
+
+static inline void concat_flash(String& s, const __FlashStringHelper *str) {
+  s.append(std::string_view(reinterpret_cast<const char *>(str)));
+}
+#endif
+
+/**
+ * Writes text into a fixed-size buffer, without allocating memory.
+ * Text that does not fit is dropped, the buffer is always kept
+ * NUL-terminated.
+ */
+struct BufferWriter {
+  BufferWriter(char *buf, size_t size) : buf(buf), size(size), len(0) {
+    if (size)
+      buf[0] = '\0';
+  }
+
+  void write(const char *str, size_t n) {
+    size_t room = this->size ? this->size - 1 - this->len : 0;
+    if (n > room)
+      n = room;
+    memcpy(this->buf + this->len, str, n);
+    this->len += n;
+    if (this->size)
+      this->buf[this->len] = '\0';
+  }
+
+  void write(char c) {
+    write(&c, 1);
+  }
+
+  // Writes a string that lives in flash (e.g. an error message)
+  void write(const __FlashStringHelper *str) {
+#ifdef ARDUINO
+    size_t n = strlen_P((PGM_P)str);
+    size_t room = this->size ? this->size - 1 - this->len : 0;
+    if (n > room)
+      n = room;
+    memcpy_P(this->buf + this->len, (PGM_P)str, n);
+    this->len += n;
+    if (this->size)
+      this->buf[this->len] = '\0';
+#else
+    const char *s = reinterpret_cast<const char *>(str);
+    write(s, strlen(s));
+#endif
+  }
+
+  void write_number(uint32_t value) {
+    char digits[10];
+    size_t n = 0;
+    do {
+      digits[sizeof(digits) - ++n] = '0' + value % 10;
+      value /= 10;
+    } while (value);
+    write(digits + sizeof(digits) - n, n);
+  }
+
+  char *buf;
+  size_t size;
+  // Number of characters written (excluding the NUL)
+  size_t len;
+};
+
+/**
+ * Reference to a string stored elsewhere (usually in the buffer that
+ * was parsed), consisting of just a pointer and a length. The string is
+ * not NUL-terminated. This does not own or copy the string, so it
+ * becomes invalid as soon as the buffer it points into is changed or
+ * freed. Use materialize() to get a copy that can be kept.
+ */
+struct StringView
+#ifdef ARDUINO
+  : public Printable
+#endif
+{
+  StringView() : str(NULL), len(0) { }
+  StringView(const char *str, size_t len) : str(str), len(len) { }
+
+  const char *data() const { return str; }
+  size_t length() const { return len; }
+
+  /**
+   * Returns a copy of the string, that stays valid after the buffer
+   * is changed.
+   */
+  String materialize() const {
+    String s;
+    concat_hack(s, str, len);
+    return s;
+  }
+
+#ifdef ARDUINO
+  size_t printTo(Print& p) const {
+    return p.write(str, len);
+  }
+#endif
+
+  const char *str;
+  size_t len;
+};
+
+/**
+ * Stores the given string into a String (copying it) or StringView (by
+ * reference), so string fields can be parsed into either.
+ */
+static inline void assign_string(String& s, StringView v) {
+  s = "";
+  concat_hack(s, v.data(), v.length());
+}
+
+static inline void assign_string(StringView& s, StringView v) {
+  s = v;
+}
+
+/**
+ * Resets a value to its default. For String, this keeps the allocated
+ * memory, so it can be reused for the next value.
+ */
+static inline void clear_value(String& s) {
+  s = "";
+}
+
+template <typename V>
+static inline void clear_value(V& v) {
+  v = V();
+}
+
+/**
+ * String with a fixed maximum length of N characters, stored inline
+ * rather than on the heap. The string is always NUL-terminated.
+ */
+template <size_t N>
+struct StaticString
+#ifdef ARDUINO
+  : public Printable
+#endif
+{
+  StaticString() : len(0) { buf[0] = '\0'; }
+
+  const char *c_str() const { return buf; }
+  size_t length() const { return len; }
+
+  /**
+   * Replaces the contents, truncating to N characters.
+   */
+  void assign(const char *str, size_t n) {
+    if (n > N)
+      n = N;
+    memcpy(buf, str, n);
+    buf[n] = '\0';
+    len = n;
+  }
+
+  /**
+   * Returns a copy of the string as a String.
+   */
+  String materialize() const {
+    String s;
+    concat_hack(s, buf, len);
+    return s;
+  }
+
+#ifdef ARDUINO
+  size_t printTo(Print& p) const {
+    return p.write(buf, len);
+  }
+#endif
+
+  char buf[N + 1];
+  typename Conditional<(N < 256), uint8_t, uint16_t>::type len;
+};
+
+template <size_t N>
+static inline void assign_string(StaticString<N>& s, StringView v) {
+  s.assign(v.data(), v.length());
+}
+
+/**
+ * Identifies the kind of error in a ParseResult, so errors can be
+ * compared and counted without looking at the message text. Use
+ * error_message() to get the text.
+ */
+enum class ParseError : uint8_t {
+  // No error
+  NONE,
+  // Error from outside this library, of which only the message is known
+  OTHER,
+  MISSING_START,
+  NO_CHECKSUM,
+  MALFORMED_CHECKSUM,
+  CHECKSUM_MISMATCH,
+  LAST_LINE_NOT_TERMINATED,
+  OBIS_ID_EMPTY,
+  OBIS_ID_OVERFLOW,
+  UNKNOWN_FIELD,
+  DUPLICATE_FIELD,
+  TRAILING_CHARACTERS,
+  MISSING_OPEN,
+  MISSING_CLOSE,
+  INVALID_STRING_LENGTH,
+  INVALID_NUMBER,
+  MISSING_UNIT,
+  INVALID_UNIT,
+  EXTRA_DATA,
+  INVALID_TIMESTAMP,
+  NO_ROOM,
+  // Number of codes, e.g. for an array of counters
+  COUNT,
+};
+
+// Do not use F() for multiply-used strings (including strings used from
+// multiple template instantiations), that would result in multiple
+// instances of the string in the binary
+static constexpr char OTHER_ERROR[] DSMR_PROGMEM = "Other error";
+static constexpr char MISSING_START[] DSMR_PROGMEM = "Data should start with /";
+static constexpr char NO_CHECKSUM[] DSMR_PROGMEM = "No checksum found";
+static constexpr char MALFORMED_CHECKSUM[] DSMR_PROGMEM = "Incomplete or malformed checksum";
+static constexpr char CHECKSUM_MISMATCH[] DSMR_PROGMEM = "Checksum mismatch";
+static constexpr char LAST_LINE_NOT_TERMINATED[] DSMR_PROGMEM = "Last dataline not CRLF terminated";
+static constexpr char OBIS_ID_EMPTY[] DSMR_PROGMEM = "OBIS id Empty";
+static constexpr char OBIS_ID_OVERFLOW[] DSMR_PROGMEM = "Obis ID has number over 255";
+static constexpr char UNKNOWN_FIELD[] DSMR_PROGMEM = "Unknown field";
+static constexpr char DUPLICATE_FIELD[] DSMR_PROGMEM = "Duplicate field";
+static constexpr char TRAILING_CHARACTERS[] DSMR_PROGMEM = "Trailing characters on data line";
+static constexpr char MISSING_OPEN[] DSMR_PROGMEM = "Missing (";
+static constexpr char MISSING_CLOSE[] DSMR_PROGMEM = "Missing )";
+static constexpr char INVALID_STRING_LENGTH[] DSMR_PROGMEM = "Invalid string length";
+static constexpr char INVALID_NUMBER[] DSMR_PROGMEM = "Invalid number";
+static constexpr char MISSING_UNIT[] DSMR_PROGMEM = "Missing unit";
+static constexpr char INVALID_UNIT[] DSMR_PROGMEM = "Invalid unit";
+static constexpr char EXTRA_DATA[] DSMR_PROGMEM = "Extra data";
+static constexpr char INVALID_TIMESTAMP[] DSMR_PROGMEM = "Invalid timestamp";
+static constexpr char NO_ROOM[] DSMR_PROGMEM = "No room for runtime field value";
+
+/**
+ * Returns the message for the given error code, or NULL for NONE. For
+ * OTHER, this is a generic message, the actual message is only known
+ * to the ParseResult that failed.
+ */
+static inline const __FlashStringHelper *error_message(ParseError code) {
+  switch (code) {
+    case ParseError::OTHER: return (const __FlashStringHelper*)OTHER_ERROR;
+    case ParseError::MISSING_START: return (const __FlashStringHelper*)MISSING_START;
+    case ParseError::NO_CHECKSUM: return (const __FlashStringHelper*)NO_CHECKSUM;
+    case ParseError::MALFORMED_CHECKSUM: return (const __FlashStringHelper*)MALFORMED_CHECKSUM;
+    case ParseError::CHECKSUM_MISMATCH: return (const __FlashStringHelper*)CHECKSUM_MISMATCH;
+    case ParseError::LAST_LINE_NOT_TERMINATED: return (const __FlashStringHelper*)LAST_LINE_NOT_TERMINATED;
+    case ParseError::OBIS_ID_EMPTY: return (const __FlashStringHelper*)OBIS_ID_EMPTY;
+    case ParseError::OBIS_ID_OVERFLOW: return (const __FlashStringHelper*)OBIS_ID_OVERFLOW;
+    case ParseError::UNKNOWN_FIELD: return (const __FlashStringHelper*)UNKNOWN_FIELD;
+    case ParseError::DUPLICATE_FIELD: return (const __FlashStringHelper*)DUPLICATE_FIELD;
+    case ParseError::TRAILING_CHARACTERS: return (const __FlashStringHelper*)TRAILING_CHARACTERS;
+    case ParseError::MISSING_OPEN: return (const __FlashStringHelper*)MISSING_OPEN;
+    case ParseError::MISSING_CLOSE: return (const __FlashStringHelper*)MISSING_CLOSE;
+    case ParseError::INVALID_STRING_LENGTH: return (const __FlashStringHelper*)INVALID_STRING_LENGTH;
+    case ParseError::INVALID_NUMBER: return (const __FlashStringHelper*)INVALID_NUMBER;
+    case ParseError::MISSING_UNIT: return (const __FlashStringHelper*)MISSING_UNIT;
+    case ParseError::INVALID_UNIT: return (const __FlashStringHelper*)INVALID_UNIT;
+    case ParseError::EXTRA_DATA: return (const __FlashStringHelper*)EXTRA_DATA;
+    case ParseError::INVALID_TIMESTAMP: return (const __FlashStringHelper*)INVALID_TIMESTAMP;
+    case ParseError::NO_ROOM: return (const __FlashStringHelper*)NO_ROOM;
+    default: return NULL;
+  }
+}
+
 /**
  * The ParseResult<T> class wraps the result of a parse function. The type
  * of the result is passed as a template parameter and can be void to
@@ -75,8 +550,12 @@ static void concat_hack(String& s, const char *append, size_t n) {
  * The ParseResult class has some convenience functions:
  *  - succeed(result): sets the result to the given value and returns
  *    the ParseResult again.
- *  - fail(err): Set the err member to the error message passed,
- *    optionally sets the ctx and return the ParseResult again.
+ *  - fail(code): Set the code member to the error code passed and the
+ *    err member to its message (see error_message()), optionally sets
+ *    the ctx and return the ParseResult again. fail(err) can be used
+ *    with a custom error message instead, which sets code to OTHER.
+ *    Both always leave err set, NONE and a NULL message are replaced
+ *    by OTHER and its generic message.
  *  - until(next): Set the next member and return the ParseResult again.
  *
  * Furthermore, ParseResults can be implicitely converted to other
@@ -115,10 +594,21 @@ struct ParseResult : public _ParseResult<ParseResult<T>, T> {
   const char *next = NULL;
   const __FlashStringHelper *err = NULL;
   const char *ctx = NULL;
+  ParseError code = ParseError::NONE;
 
+  ParseResult& fail(ParseError code, const char* ctx = NULL) {
+    // NONE would leave err NULL, which reads as success
+    if (code == ParseError::NONE)
+      code = ParseError::OTHER;
+    this->err = error_message(code);
+    this->ctx = ctx;
+    this->code = code;
+    return *this;
+  }
   ParseResult& fail(const __FlashStringHelper *err, const char* ctx = NULL) {
-    this->err = err;
+    this->err = err ? err : error_message(ParseError::OTHER);
     this->ctx = ctx;
+    this->code = ParseError::OTHER;
     return *this;
   }
   ParseResult& until(const char *next) {
@@ -129,7 +619,7 @@ struct ParseResult : public _ParseResult<ParseResult<T>, T> {
   ParseResult(const ParseResult& other) = default;
 
   template <typename T2>
-  ParseResult(const ParseResult<T2>& other): next(other.next), err(other.err), ctx(other.ctx) { }
+  ParseResult(const ParseResult<T2>& other): next(other.next), err(other.err), ctx(other.ctx), code(other.code) { }
 
   /**
    * Returns the error, including context in a fancy multi-line format.
@@ -160,14 +650,42 @@ struct ParseResult : public _ParseResult<ParseResult<T>, T> {
       res += '^';
       res += "\r\n";
     }
-    res += this->err;
+    concat_flash(res, this->err);
     return res;
   }
+
+  /**
+   * Like fullError(), but writes the error into the buffer passed
+   * (truncating it when it does not fit), so no memory is allocated.
+   * Returns the length of the text written.
+   */
+  size_t formatError(const char* start, const char* end, char *buf, size_t size) const {
+    BufferWriter out(buf, size);
+    if (this->ctx && start && end) {
+      const char *line_end = this->ctx;
+      while(line_end < end && line_end[0] != '\r' && line_end[0] != '\n') ++line_end;
+      const char *line_start = this->ctx;
+      while(line_start > start && line_start[-1] != '\r' && line_start[-1] != '\n') --line_start;
+
+      out.write(line_start, line_end - line_start);
+      out.write("\r\n", 2);
+      while (line_start++ < this->ctx)
+        out.write(' ');
+      out.write("^\r\n", 3);
+    }
+    if (this->err)
+      out.write(this->err);
+    return out.len;
+  }
 };
 
 /**
  * An OBIS id is 6 bytes, usually noted as a-b:c.d.e.f. Here we put them
  * in an array for easy parsing.
+ *
+ * An id can also be converted to and from a single integer key (using
+ * key() and from_key()), which is cheap to compare, sort and hash and
+ * can be used as a key in e.g. a map.
  */
 struct ObisId {
   uint8_t v[6];
@@ -176,11 +694,53 @@ struct ObisId {
     : v{a, b, c, d, e, f} { };
   constexpr ObisId() : v() {} // Zeroes
 
-  bool operator==(const ObisId &other) const {
-    return memcmp(&v, &other.v, sizeof(v)) == 0;
+  /**
+   * Returns all parts as a single 48-bit integer, with the first part
+   * in the most significant position. Comparing these keys orders ids
+   * by their parts, left to right.
+   */
+  constexpr uint64_t key() const {
+    return (uint64_t)v[0] << 40 | (uint64_t)v[1] << 32 | (uint32_t)v[2] << 24 |
+           (uint32_t)v[3] << 16 | (uint16_t)v[4] << 8 | v[5];
   }
+
+  /**
+   * Creates an id from a key returned by key().
+   */
+  static constexpr ObisId from_key(uint64_t key) {
+    return ObisId(key >> 40, key >> 32, key >> 24, key >> 16, key >> 8, key);
+  }
+
+  /**
+   * Returns a well-distributed 32-bit hash of the id (Fibonacci
+   * hashing of the key).
+   */
+  constexpr uint32_t hash() const {
+    return (key() * 0x9E3779B97F4A7C15ULL) >> 32;
+  }
+
+  // All comparisons are constexpr, so fields can be sorted and checked
+  // by their id at compiletime.
+  constexpr bool operator==(const ObisId &other) const { return key() == other.key(); }
+  constexpr bool operator!=(const ObisId &other) const { return key() != other.key(); }
+  constexpr bool operator<(const ObisId &other) const { return key() < other.key(); }
+  constexpr bool operator<=(const ObisId &other) const { return key() <= other.key(); }
+  constexpr bool operator>(const ObisId &other) const { return key() > other.key(); }
+  constexpr bool operator>=(const ObisId &other) const { return key() >= other.key(); }
 };
 
 } // namespace dsmr
 
+#ifndef ARDUINO
+// Allow using ObisId as key in e.g. std::unordered_map
+namespace std {
+template<>
+struct hash<dsmr::ObisId> {
+  size_t operator()(const dsmr::ObisId& id) const noexcept {
+    return id.hash();
+  }
+};
+} // namespace std
+#endif
+
 #endif // DSMR_INCLUDE_UTIL_H